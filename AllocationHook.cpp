@@ -0,0 +1,23 @@
+#include "Stats.h"
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+
+// Replacement of the global allocation functions, counting allocations for --stats and the
+// benchmarks. Not part of libmarielink.a: programs linking the library keep their own allocator
+// unless they link this file as well.
+void* operator new(size_t size) {
+    countAllocation();
+    if (void* block = malloc(size ? size : 1)) return block;
+    throw bad_alloc();
+}
+
+void operator delete(void* block) noexcept {
+    free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    free(block);
+}
@@ -0,0 +1,135 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+
+// Class implementing a bump allocator for the parsed data of a link: symbol names, definition
+// and use lists and instructions. Memory is carved out of blocks that grow geometrically and is
+// released all at once with the arena, so storing a name or a list costs no heap allocation
+// while the current block has room for it. An arena is filled by one thread at a time; once it
+// is shared, what it holds is only read.
+class Arena {
+private:
+    static constexpr size_t firstBlockSize = 4096;
+    static constexpr size_t largestBlockSize = 1 << 20;
+
+    vector<unique_ptr<char[]>> blocks;
+    char* cursor = nullptr;     // Free space of the current block
+    char* limit = nullptr;
+    size_t nextBlockSize = firstBlockSize;
+    size_t reserved = 0;        // Bytes in all blocks
+
+    static char* align(char* position, size_t alignment) {
+        return (char*) (((uintptr_t) position + alignment - 1) & ~(uintptr_t) (alignment - 1));
+    }
+
+    // Function to start a block with room for size bytes at the given alignment
+    void grow(size_t size, size_t alignment) {
+        size_t blockSize = max(nextBlockSize, size + alignment);
+        blocks.emplace_back(new char[blockSize]);
+        cursor = blocks.back().get();
+        limit = cursor + blockSize;
+        reserved += blockSize;
+        nextBlockSize = min(nextBlockSize * 2, largestBlockSize);
+    }
+
+public:
+    Arena() {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Blocks stay where they are when the arena moves, so views into it remain valid
+    Arena(Arena&& other) noexcept { *this = move(other); }
+    Arena& operator=(Arena&& other) noexcept {
+        blocks = move(other.blocks);
+        cursor = other.cursor;
+        limit = other.limit;
+        nextBlockSize = other.nextBlockSize;
+        reserved = other.reserved;
+        other.blocks.clear();
+        other.cursor = other.limit = nullptr;
+        other.nextBlockSize = firstBlockSize;
+        other.reserved = 0;
+        return *this;
+    }
+
+    // Function to allocate size bytes at the given alignment, a power of two
+    void* allocate(size_t size, size_t alignment) {
+        char* start = align(cursor, alignment);
+        if (cursor == nullptr || size > (size_t) (limit - start)) {
+            grow(size, alignment);
+            start = align(cursor, alignment);
+        }
+        cursor = start + size;
+        return start;
+    }
+
+    template <typename T> T* allocate(size_t count) {
+        return (T*) allocate(count * sizeof(T), alignof(T));
+    }
+
+    // Function to copy text into the arena, returns the copy
+    string_view store(string_view text) {
+        if (text.empty()) return string_view();
+        char* copy = allocate<char>(text.size());
+        memcpy(copy, text.data(), text.size());
+        return string_view(copy, text.size());
+    }
+
+    size_t bytesReserved() const { return reserved; }
+};
+
+
+// Class representing a list whose elements live in an arena. The list is a view: copying it
+// copies no elements, and the elements live as long as the arena. Only types without a
+// destructor can be stored, since an arena never runs one.
+template <typename T> class ArenaList {
+private:
+    static_assert(is_trivially_destructible<T>::value, "arena lists hold trivially destructible elements");
+
+    T* items = nullptr;
+    uint32_t count = 0;
+    uint32_t capacity = 0;
+
+public:
+    // Function to make room for capacity elements in arena, emptying the list
+    void reserve(Arena& arena, size_t capacity) {
+        items = capacity > 0 ? arena.allocate<T>(capacity) : nullptr;
+        count = 0;
+        this -> capacity = capacity;
+    }
+
+    // Function to append an element, moving the list to a larger allocation in arena when it is full
+    void push_back(Arena& arena, const T& item) {
+        if (count == capacity) {
+            T* previous = items;
+            capacity = max<uint32_t>(8, capacity * 2);
+            items = arena.allocate<T>(capacity);
+            if (count > 0) memcpy((void*) items, previous, count * sizeof(T));
+        }
+        items[count++] = item;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](size_t index) { return items[index]; }
+    const T& operator[](size_t index) const { return items[index]; }
+    T& back() { return items[count - 1]; }
+
+    T* begin() { return items; }
+    T* end() { return items + count; }
+    const T* begin() const { return items; }
+    const T* end() const { return items + count; }
+};
+
+#endif // ARENA_H
@@ -0,0 +1,102 @@
+#ifndef CONCURRENT_SYMBOL_TABLE_H
+#define CONCURRENT_SYMBOL_TABLE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+#include "SymbolTable.h"
+
+using namespace std;
+
+
+// Class implementing a symbol table that many threads add definitions to at once. Names are spread
+// over shards by hash, each shard a SymbolTable behind its own lock, so threads adding different
+// names rarely wait for each other. Which definition of a name wins does not depend on the order
+// the threads get there: every definition comes with its rank, its position among the definitions
+// of the link, and the lowest rank wins, as the first definition does in a serial link. A name
+// defined more than once is flagged alreadyDefined whatever the order of its definitions.
+class ConcurrentSymbolTable {
+private:
+    static const int shardCount = 64;       // A power of two
+
+    // Class holding the symbols of one shard and the rank of the definition each one holds
+    class alignas(64) Shard {
+    public:
+        mutex lock;
+        SymbolTable symbols;
+        vector<int64_t> ranks;
+    };
+
+    unique_ptr<Shard[]> shards;
+
+    // Function to return the shard of a name, picked by bits its table's slots do not use first
+    static int shardIndex(string_view name) {
+        SymbolKey key;
+        key.assign(name);
+        return (key.hash() >> 40) & (shardCount - 1);
+    }
+
+public:
+    ConcurrentSymbolTable() : shards(new Shard[shardCount]) {}
+    ConcurrentSymbolTable(const ConcurrentSymbolTable&) = delete;
+    ConcurrentSymbolTable& operator=(const ConcurrentSymbolTable&) = delete;
+
+    // Function to count the probes of the shards' lookups and inserts in stats
+    void countProbes(LinkStats* stats) {
+        for (int s = 0; s < shardCount; s++) shards[s].symbols.countProbes(stats);
+    }
+
+    // Function to add a definition of the given rank, returning the place its name is held at for
+    // rankAt. Safe to call from any number of threads.
+    int64_t insert(const Symbol& definition, int64_t rank) {
+        int s = shardIndex(definition.value);
+        Shard& shard = shards[s];
+        lock_guard<mutex> guard(shard.lock);
+        if (shard.symbols.insert(definition)) {
+            shard.ranks.push_back(rank);
+            return (int64_t) s << 32 | (shard.ranks.size() - 1);
+        }
+        // Defined before: the table flagged the symbol, a lower rank takes its place
+        int index = shard.symbols.find(definition.value);
+        if (rank < shard.ranks[index]) {
+            Symbol& symbol = shard.symbols[index];
+            symbol.Addr = definition.Addr;
+            symbol.relativeAddr = definition.relativeAddr;
+            symbol.moduleNumber = definition.moduleNumber;
+            shard.ranks[index] = rank;
+        }
+        return (int64_t) s << 32 | index;
+    }
+
+    // Function to return the rank of the definition the name held at place resolves to. Only valid
+    // once every insert has returned.
+    int64_t rankAt(int64_t place) const {
+        return shards[place >> 32].ranks[place & 0xFFFFFFFF];
+    }
+
+    // Function to return the symbols as a serial table built from the same definitions would
+    // hold them, in the order of their winning definitions. Ranks are the positions of
+    // definitionCount definitions, so the winners are placed by rank straight from the shards,
+    // without sorting. Only valid once every insert has returned.
+    SymbolTable ordered(size_t definitionCount, LinkStats* stats = nullptr) const {
+        vector<int64_t> winners(definitionCount, -1);     // Place of the symbol each rank wins, -1 if none
+        size_t symbolCount = 0;
+        for (int s = 0; s < shardCount; s++) {
+            for (size_t i = 0; i < shards[s].ranks.size(); i++) winners[shards[s].ranks[i]] = (int64_t) s << 32 | i;
+            symbolCount += shards[s].ranks.size();
+        }
+
+        SymbolTable table;
+        table.countProbes(stats);
+        table.reserve(symbolCount);
+        for (int64_t place : winners) {
+            if (place != -1) table.insert(shards[place >> 32].symbols[place & 0xFFFFFFFF]);
+        }
+        return table;
+    }
+};
+
+#endif // CONCURRENT_SYMBOL_TABLE_H
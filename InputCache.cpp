@@ -0,0 +1,52 @@
+#include "InputCache.h"
+#include "LinkCache.h"
+
+using namespace std;
+
+
+// Function to compute the key of an input
+InputKey InputCache::key(const char* data, size_t size, bool stopOnTooManyInstructions, bool keepGoing) {
+    InputKey key;
+    key.hashes[0] = hashBytes(data, size);
+    key.hashes[1] = hashBytes(data, size, 0xC2B2AE3D27D4EB4FULL);
+    key.size = size;
+    key.stopOnTooManyInstructions = stopOnTooManyInstructions;
+    key.keepGoing = keepGoing;
+    return key;
+}
+
+
+// Function to look up a parsed input, marking it as the most recently used. Returns nullptr if
+// the input is not cached.
+shared_ptr<const ParsedRange> InputCache::find(const InputKey& key) {
+    lock_guard<mutex> lock(cacheMutex);
+    auto found = index.find(key);
+    if (found == index.end()) {
+        misses++;
+        return nullptr;
+    }
+    entries.splice(entries.begin(), entries, found -> second);
+    hits++;
+    return found -> second -> parsed;
+}
+
+
+// Function to remember a parsed input, dropping the least recently used inputs beyond the budget.
+// Positions into the input are not kept, the cached modules outlive it.
+void InputCache::insert(const InputKey& key, const ParsedRange& parsed) {
+    auto copy = make_shared<ParsedRange>(parsed);
+    copy -> moduleStarts.clear();
+    copy -> end = nullptr;
+    copy -> errorPosition = nullptr;
+
+    lock_guard<mutex> lock(cacheMutex);
+    if (key.size > capacity || index.count(key)) return;
+    entries.push_front(Entry{key, move(copy)});
+    index[key] = entries.begin();
+    used += key.size;
+    while (used > capacity) {
+        used -= entries.back().key.size;
+        index.erase(entries.back().key);
+        entries.pop_back();
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef INPUT_CACHE_H
+#define INPUT_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include "Parser.h"
+
+using namespace std;
+
+
+// Class identifying an input by its contents: two independent 64-bit hashes of its bytes, its
+// size, whether it was read stopping at the first module that overflows the machine and whether
+// it was parsed on past its errors
+class InputKey {
+public:
+    uint64_t hashes[2];
+    uint64_t size;
+    bool stopOnTooManyInstructions;
+    bool keepGoing;
+
+    bool operator<(const InputKey& other) const {
+        if (hashes[0] != other.hashes[0]) return hashes[0] < other.hashes[0];
+        if (hashes[1] != other.hashes[1]) return hashes[1] < other.hashes[1];
+        if (size != other.size) return size < other.size;
+        if (stopOnTooManyInstructions != other.stopOnTooManyInstructions) return stopOnTooManyInstructions < other.stopOnTooManyInstructions;
+        return keepGoing < other.keepGoing;
+    }
+};
+
+
+// Class implementing an in-memory cache of parsed object inputs, shared by the links of a
+// long-running process. An input whose bytes were parsed before is copied out of the cache
+// instead of being parsed again, whatever it is called. Once the cached inputs add up to more
+// than the byte budget the least recently used ones are dropped. A cache holds modules parsed
+// for one machine model, and is safe to use from several links at once.
+class InputCache {
+private:
+    class Entry {
+    public:
+        InputKey key;
+        shared_ptr<const ParsedRange> parsed;
+    };
+
+    mutex cacheMutex;
+    list<Entry> entries;                            // Most recently used first
+    map<InputKey, list<Entry>::iterator> index;
+    uint64_t capacity;                              // Budget in input bytes
+    uint64_t used = 0;
+
+public:
+    atomic<size_t> hits{0};
+    atomic<size_t> misses{0};
+
+    explicit InputCache(uint64_t capacity = UINT64_C(256) << 20) : capacity(capacity) {}
+    InputCache(const InputCache&) = delete;
+    InputCache& operator=(const InputCache&) = delete;
+
+    static InputKey key(const char* data, size_t size, bool stopOnTooManyInstructions, bool keepGoing);
+    shared_ptr<const ParsedRange> find(const InputKey& key);
+    void insert(const InputKey& key, const ParsedRange& parsed);
+};
+
+#endif // INPUT_CACHE_H
@@ -0,0 +1,165 @@
+#include "Library.h"
+#include "Parser.h"
+#include "ObjectFormat.h"
+#include "LinkContext.h"
+#include <cstring>
+#include <map>
+
+using namespace std;
+
+static const char libraryMagic[8] = {'M', 'A', 'R', 'I', 'E', 'L', 'I', 'B'};
+static const uint32_t libraryVersion = 1;
+
+
+// Function to check whether an input starts with the library magic
+bool isLibrary(const char* data, size_t size) {
+    return size >= sizeof(libraryMagic) && memcmp(data, libraryMagic, sizeof(libraryMagic)) == 0;
+}
+
+
+// Function to read one entry of the member table
+LibraryMemberRecord Library::memberRecord(uint32_t member) const {
+    LibraryMemberRecord record;
+    memcpy(&record, members + member * sizeof(record), sizeof(record));
+    return record;
+}
+
+
+// Function to read one entry of the symbol index
+LibrarySymbolRecord Library::symbolRecord(uint32_t index) const {
+    LibrarySymbolRecord record;
+    memcpy(&record, symbols + index * sizeof(record), sizeof(record));
+    return record;
+}
+
+
+// Function to open a library held in memory, checking that its tables lie inside it.
+// Returns false if the library is corrupt.
+bool Library::open(const char* libraryData, size_t librarySize) {
+    data = libraryData;
+    size = librarySize;
+    if (size < sizeof(header)) return false;
+    memcpy(&header, data, sizeof(header));
+    if (header.version != libraryVersion) return false;
+
+    size_t available = size - sizeof(header);
+    if (header.memberCount > available / sizeof(LibraryMemberRecord)) return false;
+    available -= header.memberCount * sizeof(LibraryMemberRecord);
+    if (header.symbolCount > available / sizeof(LibrarySymbolRecord)) return false;
+    available -= header.symbolCount * sizeof(LibrarySymbolRecord);
+    if (header.stringTableLength > available) return false;
+
+    members = data + sizeof(header);
+    symbols = members + header.memberCount * sizeof(LibraryMemberRecord);
+    strings = symbols + header.symbolCount * sizeof(LibrarySymbolRecord);
+
+    for (uint32_t m = 0; m < header.memberCount; m++) {
+        LibraryMemberRecord record = memberRecord(m);
+        if (record.dataOffset > size || record.dataLength > size - record.dataOffset) return false;
+    }
+    for (uint32_t i = 0; i < header.symbolCount; i++) {
+        LibrarySymbolRecord record = symbolRecord(i);
+        if (record.member >= header.memberCount) return false;
+        if (record.nameOffset > header.stringTableLength || record.nameLength > header.stringTableLength - record.nameOffset) return false;
+    }
+    return true;
+}
+
+
+// Function to look up the member defining a symbol by binary search over the index.
+// Returns -1 if the library does not define the symbol.
+int Library::findMember(string_view name) const {
+    uint32_t low = 0, high = header.symbolCount;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        LibrarySymbolRecord record = symbolRecord(middle);
+        int order = string_view(strings + record.nameOffset, record.nameLength).compare(name);
+        if (order == 0) return record.member;
+        if (order < 0) low = middle + 1;
+        else high = middle;
+    }
+    return -1;
+}
+
+
+// Function to decode one member into parsed. Returns false if the member is not a valid object.
+bool Library::extract(int member, const MachineModel& machine, ParsedRange& parsed) const {
+    LibraryMemberRecord record = memberRecord(member);
+    const char* object = data + record.dataOffset;
+    return isBinaryObject(object, record.dataLength) && loadObject(object, record.dataLength, machine, parsed);
+}
+
+
+// Function to build a library from object files (text or binary), one member per module.
+// Parse errors are reported as the linker reports them. Returns the exit status for the command line.
+int buildLibrary(const vector<string>& inputNames, const string& outputName, const MachineModel& machine, OutputBuffer& out) {
+    LinkContext context(machine);
+    vector<vector<char>> memberImages;
+    map<string, uint32_t> index;    // Symbol name to the first member defining it, in name order
+    string problem;
+
+    for (const string& inputName : inputNames) {
+        Tokenizer tokenizer;
+        if (!tokenizer.openFile(inputName)) {
+            out.append("Unable to open file " + inputName + "\n");
+            return 1;
+        }
+
+        ParsedRange parsed;
+        if (!readModules(context, tokenizer, parsed)) {
+            out.append("Invalid object file " + inputName + "\n");
+            return 1;
+        }
+        if (parsed.failed) {
+            out.append(parsed.error.message());
+            out.append('\n');
+            return 1;
+        }
+
+        for (ModuleIR& module : parsed.modules) {
+            for (const Definition& definition : module.defList) index.emplace(string(definition.value), memberImages.size());
+            memberImages.emplace_back();
+            if (!encodeObject(vector<ModuleIR>{move(module)}, memberImages.back(), problem)) {
+                out.append("Unable to archive " + inputName + ": " + problem + "\n");
+                return 1;
+            }
+        }
+    }
+
+    LibraryHeader header;
+    memcpy(header.magic, libraryMagic, sizeof(libraryMagic));
+    header.version = libraryVersion;
+    header.memberCount = memberImages.size();
+    header.symbolCount = index.size();
+    header.stringTableLength = 0;
+    for (auto& entry : index) header.stringTableLength += entry.first.size();
+
+    vector<char> image;
+    // Function to append raw bytes to the image
+    auto put = [&](const void* bytes, size_t length) {
+        image.insert(image.end(), (const char*) bytes, (const char*) bytes + length);
+    };
+
+    put(&header, sizeof(header));
+    uint64_t dataOffset = sizeof(header) + header.memberCount * sizeof(LibraryMemberRecord)
+                        + header.symbolCount * sizeof(LibrarySymbolRecord) + header.stringTableLength;
+    for (const vector<char>& memberImage : memberImages) {
+        LibraryMemberRecord record = {dataOffset, memberImage.size()};
+        put(&record, sizeof(record));
+        dataOffset += memberImage.size();
+    }
+    uint32_t nameOffset = 0;
+    for (auto& entry : index) {
+        LibrarySymbolRecord record = {nameOffset, (uint32_t) entry.first.size(), entry.second};
+        put(&record, sizeof(record));
+        nameOffset += entry.first.size();
+    }
+    for (auto& entry : index) put(entry.first.data(), entry.first.size());
+    for (const vector<char>& memberImage : memberImages) put(memberImage.data(), memberImage.size());
+
+    if (!writeFile(outputName, image, problem)) {
+        out.append("Unable to archive " + outputName + ": " + problem + "\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Token.h"
+
+using namespace std;
+
+class ParsedRange;
+class OutputBuffer;
+class MachineModel;
+
+// Library format, all integers little endian:
+//   header        LibraryHeader
+//   member table  one LibraryMemberRecord per member
+//   symbol index  one LibrarySymbolRecord per defined symbol, sorted by name
+//   string table  the symbol names, referenced by the index
+//   member data   one binary object image (see ObjectFormat.h) per member
+// Every module of the archived inputs becomes one member, so a link extracts exactly the modules
+// that define the symbols it needs. A symbol defined by several members is indexed to the first.
+
+// Class representing the header of a library
+class LibraryHeader {
+public:
+    char magic[8];
+    uint32_t version;
+    uint32_t memberCount;
+    uint32_t symbolCount;
+    uint32_t stringTableLength;
+};
+
+// Class representing one entry of the member table
+class LibraryMemberRecord {
+public:
+    uint64_t dataOffset;
+    uint64_t dataLength;
+};
+
+// Class representing one entry of the symbol index
+class LibrarySymbolRecord {
+public:
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t member;
+};
+
+// Class implementing read access to a library held in memory. Opening a library only checks its
+// tables; members are decoded one at a time when they are extracted.
+class Library {
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    LibraryHeader header;
+    const char* members = nullptr;
+    const char* symbols = nullptr;
+    const char* strings = nullptr;
+
+    LibraryMemberRecord memberRecord(uint32_t member) const;
+    LibrarySymbolRecord symbolRecord(uint32_t index) const;
+
+public:
+    bool open(const char* data, size_t size);
+    int findMember(string_view name) const;
+    bool extract(int member, const MachineModel& machine, ParsedRange& parsed) const;
+    uint32_t memberCount() const { return header.memberCount; }
+};
+
+// All function prototypes required
+bool isLibrary(const char* data, size_t size);
+int buildLibrary(const vector<string>& inputNames, const string& outputName, const MachineModel& machine, OutputBuffer& out);
+
+#endif // LIBRARY_H
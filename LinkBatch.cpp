@@ -0,0 +1,106 @@
+#include "LinkBatch.h"
+#include "LinkContext.h"
+#include "OutputBuffer.h"
+#include "ThreadPool.h"
+#include <fcntl.h>
+#include <new>
+#include <unistd.h>
+
+using namespace std;
+
+
+// Class representing one job of a batch and, once it has run, its outcome
+class BatchJob {
+public:
+    string input;
+    string output;
+    int status = 0;         // Exit status the command line linker would have returned
+    string problem;         // Why the job could not run to its end, empty if it did
+};
+
+
+// Function to read the jobs of a batch list. Returns false, with the reason in out, if the list
+// cannot be read or a line holds more than an input and an output.
+static bool readJobList(const string& listFile, vector<BatchJob>& jobs, OutputBuffer& out) {
+    Tokenizer list;
+    if (!list.openFile(listFile)) {
+        out.append("Unable to open file " + listFile + "\n");
+        return false;
+    }
+    int jobLine = 0;        // Line of the last job read
+    int lineTokens = 0;
+    for (Token token = list.getNextToken(); !token.tokenContents.empty(); token = list.getNextToken()) {
+        if (token.lineNumber != jobLine) {
+            jobs.emplace_back();
+            jobs.back().input = string(token.tokenContents);
+            jobs.back().output = jobs.back().input + ".out";
+            jobLine = token.lineNumber;
+            lineTokens = 1;
+        } else if (++lineTokens == 2) {
+            jobs.back().output = string(token.tokenContents);
+        } else {
+            out.append("Invalid batch list " + listFile + " line " + to_string(jobLine) + "\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Function to link the input of a job into its output file, as the command line linker would link
+// it to standard output. Whatever goes wrong is kept in the job, so it cannot affect other jobs.
+static void runJob(BatchJob& job, const BatchOptions& options) {
+    int fd = open(job.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        job.status = 1;
+        job.problem = "unable to write " + job.output;
+        return;
+    }
+    try {
+        OutputBuffer out(fd);
+        Tokenizer file;
+        if (!file.openFile(job.input)) {
+            out.append("Unable to open file " + job.input + "\n");
+        } else {
+            LinkContext context(options.machine);
+            context.keepGoing = options.keepGoing;
+            context.streaming = options.streaming;
+            context.rootModules = options.rootModules;
+            vector<LinkInput> inputs = {LinkInput{job.input, file.inputBegin(), (size_t) (file.inputEnd() - file.inputBegin())}};
+            job.status = context.link(inputs, out).status;
+        }
+    } catch (const bad_alloc& e) {
+        job.status = 1;
+        job.problem = "out of memory";
+    }
+    close(fd);
+}
+
+
+// Function to link every job of a batch list, options.threadCount jobs at a time, with the jobs
+// shared out by work stealing so that a few slow links do not hold up the rest. Jobs fail on
+// their own: a failed job is listed on out, in list order, and the others are linked regardless.
+// Returns 1 if the list is invalid or any job failed, 0 otherwise.
+int linkBatch(const string& listFile, const BatchOptions& options, OutputBuffer& out) {
+    vector<BatchJob> jobs;
+    if (!readJobList(listFile, jobs, out)) return 1;
+
+    int workerCount = max(1, min<int>(options.threadCount, jobs.size()));
+    WorkStealingRanges ranges(jobs.size(), workerCount);
+    ThreadPool pool(workerCount);
+    for (int worker = 0; worker < workerCount; worker++) {
+        pool.submit([&, worker] {
+            size_t index;
+            while (ranges.take(worker, index)) runJob(jobs[index], options);
+        });
+    }
+    pool.wait();
+
+    int status = 0;
+    for (const BatchJob& job : jobs) {
+        if (job.status == 0 && job.problem.empty()) continue;
+        out.append(job.input + ": " + (job.problem.empty() ? "exit status " + to_string(job.status) : job.problem) + "\n");
+        status = 1;
+    }
+    return status;
+}
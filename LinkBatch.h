@@ -0,0 +1,30 @@
+#ifndef LINK_BATCH_H
+#define LINK_BATCH_H
+
+#include <string>
+#include <vector>
+#include "MachineModel.h"
+
+using namespace std;
+
+class OutputBuffer;
+
+// Batch list format: one job per line, an input file and optionally the file its listing is
+// written to, separated by white space. Without one the listing goes to the input's name with
+// ".out" appended. Blank lines are skipped. Each job is linked on its own, as if by
+//     linker [--machine <model>] [--keep-going] [--stream] [--gc-modules <roots>] <input> > <output>
+
+// Class holding the options every job of a batch is linked with
+class BatchOptions {
+public:
+    MachineModel machine;
+    int threadCount = 1;        // Jobs linked at the same time
+    bool keepGoing = false;
+    bool streaming = false;
+    vector<int> rootModules;    // Root modules of --gc-modules, empty to keep every module
+};
+
+// All function prototypes required
+int linkBatch(const string& listFile, const BatchOptions& options, OutputBuffer& out);
+
+#endif // LINK_BATCH_H
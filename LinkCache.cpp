@@ -0,0 +1,266 @@
+#include "LinkCache.h"
+#include "OutputBuffer.h"
+#include "MachineModel.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char cacheMagic[8] = {'M', 'A', 'R', 'I', 'E', 'C', 'C', 'H'};
+static const uint32_t cacheVersion = 2;
+
+
+// Function to hash a byte range, eight bytes at a time
+uint64_t hashBytes(const char* data, size_t length, uint64_t seed) {
+    const uint64_t multiplier = 0x9E3779B97F4A7C15ULL;
+    uint64_t h = seed ^ (length * multiplier);
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        h = (h ^ word) * multiplier;
+        h ^= h >> 29;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data + i, length - i);
+    h = (h ^ tail) * 0xFF51AFD7ED558CCDULL;
+    return h ^ (h >> 32);
+}
+
+
+// Class implementing a bounds-checked reader over the bytes of a cache file
+class CacheReader {
+public:
+    const char* cursor;
+    const char* end;
+    bool valid = true;
+
+    template <typename T> T get() {
+        T value{};
+        if (end - cursor < (ptrdiff_t) sizeof(T)) {
+            valid = false;
+            return value;
+        }
+        memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return value;
+    }
+
+    string_view getString(size_t length) {
+        if (end - cursor < (ptrdiff_t) length) {
+            valid = false;
+            return "";
+        }
+        string_view value(cursor, length);
+        cursor += length;
+        return value;
+    }
+};
+
+
+// Function to load the cache written by a previous link. A missing or unreadable cache file
+// simply leaves the cache empty, so every module is parsed.
+bool LinkCache::load(const string& fileName) {
+    previous.clear();
+    shared_ptr<Arena> storage = make_shared<Arena>();   // Holds the loaded modules' lists and names
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    vector<char> contents;
+    char chunk[1 << 16];
+    ssize_t bytesRead;
+    while ((bytesRead = read(fd, chunk, sizeof(chunk))) > 0) contents.insert(contents.end(), chunk, chunk + bytesRead);
+    close(fd);
+
+    CacheReader reader{contents.data(), contents.data() + contents.size()};
+    string_view magic = reader.getString(sizeof(cacheMagic));
+    if (!reader.valid || memcmp(magic.data(), cacheMagic, sizeof(cacheMagic)) != 0) return false;
+    if (reader.get<uint32_t>() != cacheVersion) return false;
+    // Results linked for another machine model do not apply
+    if (reader.getString(reader.get<uint32_t>()) != machine.describe() || !reader.valid) return false;
+    uint32_t entryCount = reader.get<uint32_t>();
+
+    for (uint32_t e = 0; e < entryCount && reader.valid; e++) {
+        CacheEntry entry;
+        entry.contentHash = reader.get<uint64_t>();
+        entry.length = reader.get<uint32_t>();
+        entry.newlines = reader.get<uint32_t>();
+
+        // Positions other than the module's first token are stored relative to it, see save
+        ModuleIR& module = entry.module;
+        module.instructionCount = reader.get<int32_t>();
+        module.useCountLine = reader.get<int32_t>();
+        module.useCountOffset = reader.get<int32_t>();
+        module.instructionCountLine = reader.get<int32_t>();
+        module.instructionCountOffset = reader.get<int32_t>();
+
+        module.storage = storage;
+        uint32_t definitionCount = reader.get<uint32_t>();
+        for (uint32_t i = 0; i < definitionCount && reader.valid; i++) {
+            Definition definition;
+            definition.value = storage -> store(reader.getString(reader.get<uint8_t>()));
+            definition.relativeAddr = reader.get<int32_t>();
+            module.defList.push_back(*storage, definition);
+        }
+        uint32_t useCount = reader.get<uint32_t>();
+        for (uint32_t i = 0; i < useCount && reader.valid; i++) module.useList.push_back(*storage, storage -> store(reader.getString(reader.get<uint8_t>())));
+        uint32_t instructionCount = reader.get<uint32_t>();
+        for (uint32_t i = 0; i < instructionCount && reader.valid; i++) {
+            char mode = reader.get<char>();
+            module.instructions.push_back(*storage, mode, reader.get<int64_t>());
+        }
+
+        uint32_t operandCount = reader.get<uint32_t>();
+        for (uint32_t i = 0; i < operandCount && reader.valid; i++) entry.moduleOperands.push_back(reader.get<int64_t>());
+        uint32_t referenceCount = reader.get<uint32_t>();
+        for (uint32_t i = 0; i < referenceCount && reader.valid; i++) entry.referencedUses.push_back(reader.get<int32_t>());
+
+        entry.relocated = reader.get<uint8_t>();
+        entry.relocationKey = reader.get<uint64_t>();
+        entry.output = reader.getString(reader.get<uint32_t>());
+        previous.push_back(move(entry));
+    }
+    if (!reader.valid) previous.clear();
+    return reader.valid;
+}
+
+
+// Function to write the cache for the next link. modules must be the modules of this link, in
+// the order they were matched or recorded.
+bool LinkCache::save(const string& fileName, const vector<ModuleIR>& modules) const {
+    if (modules.size() != current.size()) return false;
+
+    OutputBuffer image;
+    // Function to append the raw bytes of a value
+    auto put = [&](auto value) { image.append(string_view((const char*) &value, sizeof(value))); };
+    auto putName = [&](string_view name) {
+        put((uint8_t) name.size());
+        image.append(name);
+    };
+
+    image.append(string_view(cacheMagic, sizeof(cacheMagic)));
+    put(cacheVersion);
+    string model = machine.describe();
+    put((uint32_t) model.size());
+    image.append(model);
+    put((uint32_t) current.size());
+    for (size_t m = 0; m < current.size(); m++) {
+        const CacheEntry& entry = current[m];
+        const ModuleIR& module = modules[m];
+        put(entry.contentHash);
+        put(entry.length);
+        put(entry.newlines);
+
+        // Store positions as a line delta from the module's first token, and on that first line
+        // as an offset delta too, since offsets count from the first token of the line
+        put((int32_t) module.instructionCount);
+        for (int position = 0; position < 2; position++) {
+            int line = position == 0 ? module.useCountLine : module.instructionCountLine;
+            int offset = position == 0 ? module.useCountOffset : module.instructionCountOffset;
+            put((int32_t) (line - entry.startLine));
+            put((int32_t) (line == entry.startLine ? offset - entry.startOffset : offset));
+        }
+
+        put((uint32_t) module.defList.size());
+        for (const Definition& definition : module.defList) {
+            putName(definition.value);
+            put((int32_t) definition.relativeAddr);
+        }
+        put((uint32_t) module.useList.size());
+        for (string_view use : module.useList) putName(use);
+        put((uint32_t) module.instructions.size());
+        for (size_t i = 0; i < module.instructions.size(); i++) {
+            put(module.instructions.modes[i]);
+            put(module.instructions.words[i]);
+        }
+
+        put((uint32_t) entry.moduleOperands.size());
+        for (int64_t operand : entry.moduleOperands) put(operand);
+        put((uint32_t) entry.referencedUses.size());
+        for (int use : entry.referencedUses) put((int32_t) use);
+
+        put((uint8_t) entry.relocated);
+        put(entry.relocationKey);
+        put((uint32_t) entry.output.size());
+        image.append(entry.output);
+    }
+
+    // Write a temporary file and rename it, so an interrupted link never leaves a torn cache
+    string temporaryName = fileName + ".tmp";
+    int fd = open(temporaryName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    bool written = writeAll(fd, image.view().data(), image.size());
+    written = close(fd) == 0 && written;
+    return written && rename(temporaryName.c_str(), fileName.c_str()) == 0;
+}
+
+
+// Function to find the previous entry whose text span starts at position. The entry expected next
+// is tried first, then the two after it, which covers a module that was edited, inserted or
+// removed since the last link. Returns -1 if none of them matches.
+int LinkCache::match(const char* position, const char* inputEnd) {
+    auto isSeparator = [](char c) { return c == ' ' || c == '\t' || c == '\n'; };
+    for (size_t candidate = expected; candidate < expected + 3 && candidate < previous.size(); candidate++) {
+        const CacheEntry& entry = previous[candidate];
+        size_t available = inputEnd - position;
+        if (entry.length == 0 || entry.length > available) continue;
+        // The span must not end in the middle of a token that continues in this input
+        if (entry.length < available && !isSeparator(position[entry.length - 1]) && !isSeparator(position[entry.length])) continue;
+        if (hashBytes(position, entry.length) == entry.contentHash) return candidate;
+    }
+    return -1;
+}
+
+
+// Function to restore the module of a matched entry whose first token is at line and offset.
+// Returns the end of its text span; endLine receives the line the span ends on.
+const char* LinkCache::restore(int index, const char* position, int line, int offset, ModuleIR& module, int& endLine) {
+    CacheEntry& entry = previous[index];
+    module = move(entry.module);
+    module.definitionCountLine = line;
+    module.definitionCountOffset = offset;
+    int* positions[2][2] = {{&module.useCountLine, &module.useCountOffset}, {&module.instructionCountLine, &module.instructionCountOffset}};
+    for (auto& position : positions) {
+        if (*position[0] == 0) *position[1] += offset;
+        *position[0] += line;
+    }
+
+    entry.startLine = line;
+    entry.startOffset = offset;
+    current.push_back(move(entry));
+    expected = index + 1;
+    moduleHits++;
+
+    endLine = line + current.back().newlines;
+    return position + current.back().length;
+}
+
+
+// Function to remember a module that was parsed because no entry matched it. Its text span runs
+// from start to end, and its first token is at line and offset.
+void LinkCache::record(const ModuleIR& module, const char* start, const char* end, int line, int offset) {
+    CacheEntry entry;
+    entry.contentHash = hashBytes(start, end - start);
+    entry.length = end - start;
+    entry.newlines = count(start, end, '\n');
+    entry.startLine = line;
+    entry.startOffset = offset;
+
+    // Collect what the relocation of the module depends on besides its own text
+    for (size_t i = 0; i < module.instructions.size(); i++) {
+        char mode = module.instructions.modes[i];
+        int64_t word = module.instructions.words[i];
+        if (word > machine.largestInstruction()) continue;
+        int64_t operand = word % machine.opcodeRadix;
+        if (mode == 'M') entry.moduleOperands.push_back(operand);
+        if (mode == 'E' && operand >= 0 && operand < module.useList.size()) entry.referencedUses.push_back(operand);
+    }
+    sort(entry.moduleOperands.begin(), entry.moduleOperands.end());
+    entry.moduleOperands.erase(unique(entry.moduleOperands.begin(), entry.moduleOperands.end()), entry.moduleOperands.end());
+    sort(entry.referencedUses.begin(), entry.referencedUses.end());
+    entry.referencedUses.erase(unique(entry.referencedUses.begin(), entry.referencedUses.end()), entry.referencedUses.end());
+    current.push_back(move(entry));
+}
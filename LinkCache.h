@@ -0,0 +1,71 @@
+#ifndef LINK_CACHE_H
+#define LINK_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Token.h"
+#include "MachineModel.h"
+
+using namespace std;
+
+
+// Class representing one module remembered by the link cache. The module's text span runs from
+// its first token to the first token of the next module (or the end of the input), so identical
+// bytes at a module boundary always parse to the identical module.
+class CacheEntry {
+public:
+    uint64_t contentHash = 0;       // Hash of the module's text span
+    uint32_t length = 0;            // Length of the text span in bytes
+    uint32_t newlines = 0;          // Line breaks inside the text span
+    int startLine = 0;              // Position of the module's first token in the current input
+    int startOffset = 0;
+    ModuleIR module;                // Parsed module, only kept for entries loaded from disk
+
+    vector<int64_t> moduleOperands; // Operands of the module's M instructions, without duplicates
+    vector<int> referencedUses;     // Use list entries referenced by E instructions
+
+    bool relocated = false;         // Whether output holds a relocation of the module
+    uint64_t relocationKey = 0;     // Hash of everything the relocation depends on
+    string output;                  // Memory map entries and warnings printed for the module
+};
+
+
+// Class implementing the on-disk incremental link cache. Modules are recognised by the content
+// hash of their text span: a module whose bytes are unchanged is restored instead of parsed, and
+// its memory map text is reused when its relocation key (base address, memory map index, the
+// module bases it references through M instructions and the addresses of its external symbols)
+// is unchanged as well. Output is therefore identical to a clean link. A cache belongs to one
+// machine model and serves one link at a time.
+class LinkCache {
+private:
+    MachineModel machine;           // Model the cached modules are linked for
+    vector<CacheEntry> previous;    // Entries loaded from the cache file, in module order
+    vector<CacheEntry> current;     // Entries of the link in progress, one per module
+    size_t expected = 0;            // Previous entry expected to match the next module
+
+public:
+    atomic<size_t> moduleHits{0};
+    atomic<size_t> relocationHits{0};
+
+    explicit LinkCache(const MachineModel& machine = MachineModel()) : machine(machine) {}
+
+    bool load(const string& fileName);
+    bool save(const string& fileName, const vector<ModuleIR>& modules) const;
+
+    // Parsing side, used while the modules are read in order
+    int match(const char* position, const char* inputEnd);
+    const char* restore(int entry, const char* position, int line, int offset, ModuleIR& module, int& endLine);
+    void record(const ModuleIR& module, const char* start, const char* end, int line, int offset);
+
+    // Relocation side, safe to call concurrently for different modules
+    bool covers(size_t moduleCount) const { return current.size() == moduleCount; }
+    CacheEntry& entry(size_t moduleIndex) { return current[moduleIndex]; }
+    size_t moduleCount() const { return current.size(); }
+};
+
+uint64_t hashBytes(const char* data, size_t length, uint64_t seed = 0);
+
+#endif // LINK_CACHE_H
@@ -0,0 +1,134 @@
+#include "LinkContext.h"
+#include <string_view>
+
+using namespace std;
+
+
+// Function to print a parse error, keeping it in diagnostics unless that is null. With several
+// inputs the position alone is ambiguous, so the input is named as well.
+static void reportParseError(ParseError& error, const vector<LinkInput>& inputs, OutputBuffer& out, vector<string>* diagnostics) {
+    if (inputs.size() > 1) error.fileName = inputs[error.fileIndex].name;
+    string message = error.message();
+    out.append(message);
+    out.append('\n');
+    if (diagnostics) diagnostics -> push_back(move(message));
+}
+
+
+// Function to link the inputs as consecutive modules in the given order, writing the listing to
+// out as it is produced. A parse error or an invalid input stops the link; everything printed
+// before it stays in the listing, followed by the error. With keepGoing every parse error of the
+// inputs is listed instead, and nothing else.
+LinkResult LinkContext::link(const vector<LinkInput>& inputs, OutputBuffer& out) {
+    LinkResult result;
+    moduleBases.clear();
+    AllocationCounter allocations(stats.enabled);
+    uint64_t outputStart = out.bytesWritten() + out.size();
+    OutputBuffer line(-1, 256);     // Diagnostic being formatted
+    vector<string>* diagnostics = record ? &record -> diagnostics : nullptr;
+
+    try {
+        // Perform the first pass of the linker, generating an initial symbol table and the parsed modules.
+        {
+            PhaseScope phase(stats, "firstPass");
+            result.symbolTable = firstPass(*this, inputs, result.modules, out);
+        }
+
+        {
+            PhaseScope phase(stats, "output");
+            out.append("Symbol Table\n");
+            // Iterate through the symbol table to print each symbol and its address.
+            for (auto& symbol : result.symbolTable) {
+                if (!symbol.alreadyDefined) {
+                    out.append(symbol.value);
+                    out.append('=');
+                    out.appendNumber(symbol.Addr);
+                    out.append('\n');
+                    continue;
+                }
+                // If the symbol is defined multiple times, the first definition is used.
+                line.append(symbol.value);
+                line.append('=');
+                line.appendNumber(symbol.Addr);
+                line.append(" Error: This variable is multiple times defined; first value used");
+                listDiagnostic(line, out, diagnostics);
+            }
+            // A memory map written to an image has no lines in the listing, so no heading either
+            if (image == nullptr) out.append("\nMemory Map\n");
+        }
+
+        // Perform the second pass of the linker over the parsed modules, marking the symbols that are used.
+        {
+            PhaseScope phase(stats, "secondPass");
+            secondPass(*this, result.modules, result.symbolTable, out);
+        }
+    } catch (ParseError& error) {
+        reportParseError(error, inputs, out, diagnostics);
+        result.status = 1;
+    } catch (ParseErrorList& list) {
+        for (ParseError& error : list.errors) reportParseError(error, inputs, out, diagnostics);
+        result.status = 1;
+    } catch (const InputError& error) {
+        line.append(error.message());
+        listDiagnostic(line, out, diagnostics);
+        result.status = 1;
+    }
+
+    {
+        PhaseScope phase(stats, "output");
+        if (result.status == 0) {
+            out.append('\n'); // Print an empty line for formatting.
+            // Modules dropped by --gc-modules, whose symbols are not in the table
+            for (int i = 0; i < moduleBases.size(); i++) {
+                if (moduleBases[i].removed) {
+                    line.append("Warning: Module ");
+                    line.appendNumber(i);
+                    line.append(": removed, not reachable from the root modules");
+                    listDiagnostic(line, out, diagnostics);
+                }
+            }
+            // Iterate through the final symbol table to check for unused symbols.
+            for (auto& symbol : result.symbolTable) {
+                // If a symbol was defined but never used, print a warning message.
+                if (!symbol.used) {
+                    line.append("Warning: Module ");
+                    line.appendNumber(symbol.moduleNumber - 1);
+                    line.append(": ");
+                    line.append(symbol.value);
+                    line.append(" was defined but never used");
+                    listDiagnostic(line, out, diagnostics);
+                }
+            }
+        }
+        out.flush();
+    }
+
+    // The table outlives the context, so it stops counting into the context's stats
+    result.symbolTable.countProbes(nullptr);
+    if (stats.enabled) {
+        stats.allocations += allocations.count();
+        stats.bytesWritten += out.bytesWritten() + out.size() - outputStart;
+    }
+    return result;
+}
+
+
+// Function to link the inputs, keeping the listing in the result along with the memory map and
+// the diagnostics, recorded from the link as it lists them
+LinkResult LinkContext::link(const vector<LinkInput>& inputs) {
+    OutputBuffer out;
+    LinkRecord linkRecord;
+    record = &linkRecord;
+    LinkResult result;
+    try {
+        result = link(inputs, out);
+    } catch (...) {
+        record = nullptr;
+        throw;
+    }
+    record = nullptr;
+    result.listing.assign(out.view());
+    result.memoryMap = move(linkRecord.memoryMap);
+    result.diagnostics = move(linkRecord.diagnostics);
+    return result;
+}
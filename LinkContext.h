@@ -0,0 +1,108 @@
+#ifndef LINK_CONTEXT_H
+#define LINK_CONTEXT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Token.h"
+#include "SymbolTable.h"
+#include "OutputBuffer.h"
+#include "MachineModel.h"
+#include "LinkCache.h"
+#include "Stats.h"
+#include "Parser.h"
+
+using namespace std;
+
+class InputCache;
+class MemoryImage;
+
+// Library interface of the linker (libmarielink.a). A link reads its inputs from memory, writes
+// nothing to the process's standard streams and never exits; every piece of state it touches
+// lives in its LinkContext, so links in separate contexts can run on separate threads at once.
+//
+//     LinkContext context(machine);
+//     LinkResult result = context.link({{"a.obj", data, size}});
+//     if (result.status != 0) ... result.diagnostics.back() ...
+
+
+// Class representing one input of a link: a text object, a binary object or a library, held in
+// memory by the caller for the duration of the link
+class LinkInput {
+public:
+    string name;            // Named in parse errors when several inputs are linked
+    const char* data;
+    size_t size;
+};
+
+
+// Class representing one word of the memory map
+class MemoryWord {
+public:
+    int64_t value = 0;
+    string error;           // Error reported for the word, empty if there is none
+};
+
+
+// Class representing the outcome of a link
+class LinkResult {
+public:
+    int status = 0;                 // 0 when linked, 1 when a parse error or an invalid input stopped the link
+    vector<ModuleIR> modules;       // Modules in link order, extracted library members included
+    SymbolTable symbolTable;
+
+    // Only filled when the listing is kept in the result
+    string listing;                 // The symbol table, memory map and warnings the linker prints
+    vector<MemoryWord> memoryMap;   // Memory map words relocated before the link stopped, if it did
+    vector<string> diagnostics;     // Warning and error lines of the listing, in listing order
+};
+
+
+// Class collecting the memory map and the diagnostics of a link as they are produced, for a result
+// that keeps them. Modules may be relocated on several threads, so each one records its memory map
+// words and warnings into entries of its own; the second pass gathers the warnings in module order.
+class LinkRecord {
+public:
+    vector<MemoryWord> memoryMap;               // Word of each memory map index, sized by the second pass
+    vector<vector<string>> moduleDiagnostics;   // Diagnostics of each module's memory map lines
+    vector<string> diagnostics;                 // Diagnostics of the link, in listing order
+};
+
+
+// Function to list the diagnostic line formatted in line, also keeping it in diagnostics unless
+// that is null, and empty line for the next one
+inline void listDiagnostic(OutputBuffer& line, OutputBuffer& out, vector<string>* diagnostics) {
+    out.append(line.view());
+    out.append('\n');
+    if (diagnostics) diagnostics -> emplace_back(line.view());
+    line.clear();
+}
+
+
+// Class holding the state of a link: the machine model, the options of the run, the module base
+// table filled by the first pass and the instrumentation. A context serves one link at a time.
+class LinkContext {
+public:
+    MachineModel machine;           // Machine the modules are linked for
+    int threadCount = 1;            // Threads parsing and relocating the modules
+    bool keepGoing = false;         // Parse on past errors and report all of them instead of the first
+    bool streaming = false;         // Only check instructions in the first pass, read them again in a pipelined second pass
+    size_t parallelChunkSize = 1 << 20;     // Least input per chunk when the first pass parses on several threads
+    bool concurrentSymbols = false; // Resolve many definitions on threadCount threads instead of serially
+    LinkCache* cache = nullptr;     // Incremental link cache, for the same machine model
+    InputCache* inputCache = nullptr;   // Parsed inputs shared with other links, for the same machine model
+    MemoryImage* image = nullptr;   // Receives the memory map and its errors instead of the listing, when set
+    LinkRecord* record = nullptr;   // Receives the memory map and the diagnostics along with the listing, when set
+    vector<int> rootModules;        // Modules kept with every module they reach (--gc-modules), all modules are kept when empty
+    LinkStats stats;                // Recorded when stats.enabled is set
+    vector<Module> moduleBases;     // Base address and size of each module, assigned by the first pass
+
+    explicit LinkContext(const MachineModel& machine = MachineModel()) : machine(machine) {}
+    LinkContext(const LinkContext&) = delete;
+    LinkContext& operator=(const LinkContext&) = delete;
+
+    LinkResult link(const vector<LinkInput>& inputs, OutputBuffer& out);
+    LinkResult link(const vector<LinkInput>& inputs);
+};
+
+#endif // LINK_CONTEXT_H
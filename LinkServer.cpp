@@ -0,0 +1,250 @@
+#include "LinkServer.h"
+#include "LinkContext.h"
+#include "InputCache.h"
+#include "OutputBuffer.h"
+#include "ThreadPool.h"
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Limits on a job, so a malformed one is rejected instead of exhausting memory
+static const uint32_t maxJobInputs = 1 << 16;
+static const uint32_t maxNameLength = 1 << 16;
+
+// Seconds a client may stall in the middle of sending a job or taking its reply before it is dropped
+static const int clientTimeout = 10;
+
+
+// Function to read exactly length bytes, returns false at the end of the stream or on an error
+static bool readExact(int fd, void* data, size_t length) {
+    char* cursor = (char*) data;
+    while (length > 0) {
+        ssize_t count = read(fd, cursor, length);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return false;
+        cursor += count;
+        length -= count;
+    }
+    return true;
+}
+
+template <typename T> static bool readValue(int fd, T& value) {
+    return readExact(fd, &value, sizeof(T));
+}
+
+static bool readText(int fd, string& text, uint64_t length) {
+    try {
+        text.resize(length);
+    } catch (const bad_alloc& e) {
+        return false;
+    } catch (const length_error& e) {
+        return false;
+    }
+    return readExact(fd, text.data(), length);
+}
+
+template <typename T> static void appendValue(OutputBuffer& out, T value) {
+    out.append(string_view((const char*) &value, sizeof(T)));
+}
+
+
+// Function to read one job. Returns false when the client hung up or sent a malformed job.
+static bool readJob(int fd, vector<JobInput>& job) {
+    uint32_t inputCount;
+    if (!readValue(fd, inputCount) || inputCount == 0 || inputCount > maxJobInputs) return false;
+    job.assign(inputCount, JobInput());
+    for (JobInput& input : job) {
+        uint32_t nameLength;
+        uint64_t dataLength;
+        if (!readValue(fd, input.kind) || input.kind > jobInputContent) return false;
+        if (!readValue(fd, nameLength) || nameLength > maxNameLength || !readText(fd, input.name, nameLength)) return false;
+        if (!readValue(fd, dataLength) || (input.kind == jobInputPath && dataLength > PATH_MAX)) return false;
+        if (!readText(fd, input.data, dataLength)) return false;
+    }
+    return true;
+}
+
+
+// Function to run one job the way the command line linker runs a link, writing the listing to
+// listing. Returns the exit status.
+static int runJob(const vector<JobInput>& job, const MachineModel& machine, InputCache& cache, OutputBuffer& listing) {
+    vector<Tokenizer> files(job.size());
+    vector<LinkInput> inputs;
+    for (int i = 0; i < job.size(); i++) {
+        const JobInput& input = job[i];
+        if (input.kind == jobInputContent) {
+            inputs.push_back(LinkInput{input.name, input.data.data(), input.data.size()});
+            continue;
+        }
+        if (!files[i].openFile(input.data)) {
+            listing.append("Unable to open file " + input.name + "\n");
+            return 0;
+        }
+        inputs.push_back(LinkInput{input.name, files[i].inputBegin(), (size_t) (files[i].inputEnd() - files[i].inputBegin())});
+    }
+
+    LinkContext context(machine);
+    context.inputCache = &cache;
+    return context.link(inputs, listing).status;
+}
+
+
+// Function to run one job of a connection and reply to it, then hand the connection back to the
+// server through handBack to wait for its next job. A connection whose reply cannot be written is closed.
+static void serveJob(int fd, const vector<JobInput>& job, const MachineModel& machine, InputCache& cache, int handBack) {
+    OutputBuffer listing;
+    int32_t status = runJob(job, machine, cache, listing);
+    OutputBuffer reply(-1, 12);
+    appendValue(reply, status);
+    appendValue<uint64_t>(reply, listing.size());
+    if (writeAll(fd, reply.view().data(), reply.size()) && writeAll(fd, listing.view().data(), listing.size())
+        && writeAll(handBack, (const char*) &fd, sizeof(fd))) return;
+    close(fd);
+}
+
+
+// Function to serve link jobs on a Unix domain socket until the process is stopped. This thread
+// accepts connections and reads their jobs; each job then runs on one of threadCount workers, which
+// hands the connection back once it replied. An open connection with no job in flight holds no
+// worker, so idle clients never keep others waiting; a client that stalls part way through sending
+// a job holds up the others for at most clientTimeout seconds before it is dropped. All jobs share
+// one cache of parsed inputs.
+// Returns the exit status if the socket cannot be set up.
+int serveLinks(const string& socketPath, const MachineModel& machine, int threadCount, OutputBuffer& out) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        out.append("Unable to serve on " + socketPath + ": path too long\n");
+        return 1;
+    }
+    memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    // A socket left behind by an earlier server is replaced, anything else at the path is kept
+    struct stat status;
+    if (stat(socketPath.c_str(), &status) == 0 && S_ISSOCK(status.st_mode)) unlink(socketPath.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0 || bind(listener, (sockaddr*) &address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+        out.append("Unable to serve on " + socketPath + ": " + strerror(errno) + "\n");
+        if (listener >= 0) close(listener);
+        return 1;
+    }
+
+    // A client hanging up mid-reply only ends its own connection
+    signal(SIGPIPE, SIG_IGN);
+
+    // Workers hand connections back through a pipe, waking the poll below
+    int handBack[2];
+    if (pipe2(handBack, O_CLOEXEC) != 0) {
+        out.append("Unable to serve on " + socketPath + ": " + strerror(errno) + "\n");
+        close(listener);
+        return 1;
+    }
+
+    InputCache cache;
+    ThreadPool pool(threadCount);
+    vector<pollfd> waiting = {{listener, POLLIN, 0}, {handBack[0], POLLIN, 0}};   // Then the idle connections
+    timeval timeout = {clientTimeout, 0};
+    while (true) {
+        if (poll(waiting.data(), waiting.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        // Read the job of every connection that sent one, or close it if the client hung up
+        for (size_t i = 2; i < waiting.size();) {
+            if (waiting[i].revents == 0) {
+                i++;
+                continue;
+            }
+            int client = waiting[i].fd;
+            waiting[i] = waiting.back();
+            waiting.pop_back();
+            vector<JobInput> job;
+            if (!readJob(client, job)) {
+                close(client);
+                continue;
+            }
+            pool.submit([&, client, job = move(job)] { serveJob(client, job, machine, cache, handBack[1]); });
+        }
+
+        int client;
+        if (waiting[1].revents != 0 && readValue(handBack[0], client)) waiting.push_back({client, POLLIN, 0});
+        if (waiting[0].revents == 0) continue;
+        client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EMFILE || errno == ENFILE) usleep(1000);   // Wait for a connection to close
+            else if (errno != EINTR && errno != ECONNABORTED) break;
+            continue;
+        }
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        waiting.push_back({client, POLLIN, 0});
+    }
+    out.append("Unable to serve on " + socketPath + ": " + strerror(errno) + "\n");
+    close(listener);
+    return 1;
+}
+
+
+// Function to send the files to a link server as one job and print its listing. Paths are sent
+// absolute, since the server does not share the client's working directory; with sendContents
+// the files are read here and sent inline instead. Returns the exit status of the link.
+int requestLink(const string& socketPath, const vector<string>& fileNames, bool sendContents, OutputBuffer& out) {
+    OutputBuffer job;
+    appendValue<uint32_t>(job, fileNames.size());
+    char directory[PATH_MAX];
+    string workingDirectory = getcwd(directory, sizeof(directory)) ? directory : ".";
+    for (const string& fileName : fileNames) {
+        Tokenizer file;
+        string_view data;
+        string path;
+        if (sendContents) {
+            if (!file.openFile(fileName)) {
+                out.append("Unable to open file " + fileName + "\n");
+                return 0;
+            }
+            data = string_view(file.inputBegin(), file.inputEnd() - file.inputBegin());
+        } else {
+            path = fileName[0] == '/' ? fileName : workingDirectory + "/" + fileName;
+            data = path;
+        }
+        appendValue<uint8_t>(job, sendContents ? jobInputContent : jobInputPath);
+        appendValue<uint32_t>(job, fileName.size());
+        job.append(fileName);
+        appendValue<uint64_t>(job, data.size());
+        job.append(data);
+    }
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    int server = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool connected = server >= 0 && socketPath.size() < sizeof(address.sun_path);
+    if (connected) {
+        memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+        connected = connect(server, (sockaddr*) &address, sizeof(address)) == 0;
+    }
+
+    int32_t status = 1;
+    uint64_t length = 0;
+    string listing;
+    bool answered = connected && writeAll(server, job.view().data(), job.size()) && readValue(server, status)
+                 && readValue(server, length) && readText(server, listing, length);
+    if (server >= 0) close(server);
+    if (!answered) {
+        out.append("Unable to reach the link server at " + socketPath + "\n");
+        return 1;
+    }
+    out.append(listing);
+    return status;
+}
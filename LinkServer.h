@@ -0,0 +1,38 @@
+#ifndef LINK_SERVER_H
+#define LINK_SERVER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MachineModel.h"
+
+using namespace std;
+
+class OutputBuffer;
+
+// Link server protocol, all integers little endian, over a Unix domain stream socket. A client
+// may send any number of jobs on one connection, reading the reply to each before the next:
+//   job     uint32 input count, then per input: uint8 kind (0 path, 1 inline content),
+//           uint32 name length, the name, uint64 data length, the data
+//   reply   int32 exit status, uint64 listing length, the listing
+// The data of a path input is the path the server opens; the data of an inline input is the
+// object or library itself. The name stands for the input in diagnostics, as a file name given
+// on the command line does. The listing and status are exactly what the command line linker
+// prints and exits with for the same inputs.
+
+static const uint8_t jobInputPath = 0;
+static const uint8_t jobInputContent = 1;
+
+// Class representing one input of a link job
+class JobInput {
+public:
+    uint8_t kind;
+    string name;
+    string data;    // Path or contents, by kind
+};
+
+// All function prototypes required
+int serveLinks(const string& socketPath, const MachineModel& machine, int threadCount, OutputBuffer& out);
+int requestLink(const string& socketPath, const vector<string>& fileNames, bool sendContents, OutputBuffer& out);
+
+#endif // LINK_SERVER_H
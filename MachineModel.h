@@ -0,0 +1,92 @@
+#ifndef MACHINE_MODEL_H
+#define MACHINE_MODEL_H
+
+#include <climits>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+
+// Class describing the machine the linker targets. An instruction is opcode * opcodeRadix + operand;
+// the default model is the 512-word machine with four-digit instructions and reproduces the
+// classic linker exactly. A different model is chosen at runtime with --machine.
+class MachineModel {
+public:
+    int64_t memorySize = 512;       // Words of memory, the limit for absolute operands and instructions
+    int64_t opcodeRadix = 1000;     // Instruction value of one opcode step
+    int64_t opcodeCount = 10;       // Opcodes 0 .. opcodeCount - 1 are legal
+    int64_t immediateLimit = 900;   // Immediate operands from this value on are illegal
+    int maxDefinitions = 16;        // Definitions per module
+    int maxUses = 16;               // Uses per module
+    int maxSymbolLength = 16;       // Characters per symbol name
+    int indexWidth = 3;             // Digits of a memory map index (wider indices are not cut)
+    int addressWidth = 4;           // Digits of a memory map address
+
+    // Function to return the largest legal instruction, which also replaces an illegal opcode
+    int64_t largestInstruction() const { return opcodeCount * opcodeRadix - 1; }
+
+    // Function to return the largest operand, which replaces an illegal immediate operand
+    int64_t largestOperand() const { return opcodeRadix - 1; }
+
+    // Function to tell whether instructions are read as 64-bit values. The default model reads
+    // them as int, so values outside its range are reported as NUM_EXPECTED as before.
+    bool wideInstructions() const { return largestInstruction() > INT_MAX; }
+
+    // Function to check that the model is usable: positive sizes, an immediate limit inside an
+    // operand, instructions that fit the 61 bits of a binary object instruction word and symbol
+    // names that fit the one-byte length of the binary formats
+    bool valid() const {
+        if (memorySize <= 0 || opcodeRadix <= 0 || opcodeCount <= 0 || immediateLimit < 0) return false;
+        if (immediateLimit > opcodeRadix || opcodeCount > ((INT64_C(1) << 60) - 1) / opcodeRadix) return false;
+        if (maxDefinitions < 0 || maxUses < 0 || maxSymbolLength <= 0 || maxSymbolLength > 255) return false;
+        return indexWidth >= 0 && indexWidth <= 20 && addressWidth >= 0 && addressWidth <= 20;
+    }
+
+    // Function to read a descriptor of comma separated key=value pairs, for example
+    // "words=65536,radix=100000,immediate=90000". Keys not given keep their default.
+    // Returns false if a key is unknown, a value is not a number or the model is not valid.
+    bool parse(string_view descriptor) {
+        while (!descriptor.empty()) {
+            size_t comma = descriptor.find(',');
+            string_view pair = descriptor.substr(0, comma);
+            descriptor = comma == string_view::npos ? string_view() : descriptor.substr(comma + 1);
+
+            size_t equals = pair.find('=');
+            if (equals == string_view::npos) return false;
+            string_view key = pair.substr(0, equals);
+            string text(pair.substr(equals + 1));
+            size_t digits = 0;
+            long long value;
+            try {
+                value = stoll(text, &digits);
+            } catch (const exception& e) {
+                return false;
+            }
+            if (digits != text.size() || value < 0) return false;
+
+            if (key == "words") memorySize = value;
+            else if (key == "radix") opcodeRadix = value;
+            else if (key == "opcodes") opcodeCount = value;
+            else if (key == "immediate") immediateLimit = value;
+            else if (key == "defs" && value <= INT_MAX) maxDefinitions = value;
+            else if (key == "uses" && value <= INT_MAX) maxUses = value;
+            else if (key == "symbol" && value <= INT_MAX) maxSymbolLength = value;
+            else if (key == "index-width" && value <= INT_MAX) indexWidth = value;
+            else if (key == "address-width" && value <= INT_MAX) addressWidth = value;
+            else return false;
+        }
+        return valid();
+    }
+
+    // Function to describe the model, used to tell whether cached link results still apply
+    string describe() const {
+        return to_string(memorySize) + "," + to_string(opcodeRadix) + "," + to_string(opcodeCount) + ","
+             + to_string(immediateLimit) + "," + to_string(maxDefinitions) + "," + to_string(maxUses) + ","
+             + to_string(maxSymbolLength) + "," + to_string(indexWidth) + "," + to_string(addressWidth);
+    }
+};
+
+#endif // MACHINE_MODEL_H
@@ -0,0 +1,252 @@
+#include "MemoryImage.h"
+#include "MachineModel.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char imageMagic[8] = {'M', 'A', 'R', 'I', 'E', 'I', 'M', 'G'};
+static const char diagnosticsMagic[8] = {'M', 'A', 'R', 'I', 'E', 'D', 'I', 'A'};
+static const char relocationsMagic[8] = {'M', 'A', 'R', 'I', 'E', 'R', 'E', 'L'};
+static const uint32_t imageVersion = 2;
+
+// Records hold a memory map index in their low 56 bits and a code in the top 8
+static const uint64_t recordIndexMask = (UINT64_C(1) << 56) - 1;
+
+
+// Function to create a file of size bytes and have fill write its contents through a shared
+// mapping, so the bytes go straight to the page cache without a copy through write()
+template <typename Fill>
+static bool writeMapped(const string& fileName, size_t size, Fill fill, string& problem) {
+    int fd = open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    bool written = fd >= 0 && ftruncate(fd, size) == 0;
+    if (written) {
+        void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        written = mapping != MAP_FAILED;
+        if (written) {
+            fill((char*) mapping);
+            written = munmap(mapping, size) == 0;
+        }
+    }
+    if (fd >= 0) written = close(fd) == 0 && written;
+    if (!written) problem = "unable to write " + fileName;
+    return written;
+}
+
+
+// Function to write the words of an image under header, in 4 bytes each if header asks for it
+static bool writeWords(const string& fileName, const ImageHeader& header, const vector<int64_t>& words, string& problem) {
+    size_t imageSize = sizeof(header) + words.size() * header.wordBytes;
+    return writeMapped(fileName, imageSize, [&](char* data) {
+        memcpy(data, &header, sizeof(header));
+        char* cursor = data + sizeof(header);
+        if (header.wordBytes == 8) {
+            memcpy(cursor, words.data(), words.size() * sizeof(int64_t));
+            return;
+        }
+        for (int64_t word : words) {
+            int32_t narrowWord = word;
+            memcpy(cursor, &narrowWord, 4);
+            cursor += 4;
+        }
+    }, problem);
+}
+
+
+// Function to write a sidecar of records, one for each index whose code is not 0. The diagnostics
+// and the relocation records share this layout.
+static bool writeRecords(const string& fileName, const char* magic, const vector<uint8_t>& codes, string& problem) {
+    vector<uint64_t> records;
+    for (size_t index = 0; index < codes.size(); index++) {
+        if (codes[index] != 0) records.push_back(index | (uint64_t) codes[index] << 56);
+    }
+    DiagnosticsHeader header = {};
+    memcpy(header.magic, magic, sizeof(header.magic));
+    header.version = imageVersion;
+    header.recordBytes = sizeof(uint64_t);
+    header.recordCount = records.size();
+    return writeMapped(fileName, sizeof(header) + records.size() * sizeof(uint64_t), [&](char* data) {
+        memcpy(data, &header, sizeof(header));
+        if (!records.empty()) memcpy(data + sizeof(header), records.data(), records.size() * sizeof(uint64_t));
+    }, problem);
+}
+
+
+// Function to write a memory image, its diagnostics sidecar and, when the image recorded them,
+// its relocation records. Words are stored in 4 bytes when all of them fit.
+bool writeImage(const MemoryImage& image, const MachineModel& machine, const string& fileName, string& problem) {
+    bool narrow = true;
+    for (int64_t word : image.words) narrow = narrow && word >= INT32_MIN && word <= INT32_MAX;
+
+    ImageHeader header = {};
+    memcpy(header.magic, imageMagic, sizeof(imageMagic));
+    header.version = imageVersion;
+    header.wordBytes = narrow ? 4 : 8;
+    header.wordCount = image.words.size();
+    header.opcodeRadix = machine.opcodeRadix;
+    header.memorySize = machine.memorySize;
+    header.baseAddress = 0;
+    return writeWords(fileName, header, image.words, problem)
+        && writeRecords(fileName + ".diag", diagnosticsMagic, image.errors, problem)
+        && (!image.recordFixups || writeRecords(fileName + ".reloc", relocationsMagic, image.fixups, problem));
+}
+
+
+// Function to map a whole file, writable through a shared mapping if writable is set, setting
+// size to its length. Returns nullptr, with the reason in problem, if it cannot be opened or mapped.
+static char* mapFile(const string& fileName, bool writable, size_t& size, string& problem) {
+    int fd = open(fileName.c_str(), writable ? O_RDWR : O_RDONLY);
+    struct stat status;
+    void* mapping = MAP_FAILED;
+    if (fd >= 0 && fstat(fd, &status) == 0 && status.st_size > 0) {
+        size = status.st_size;
+        mapping = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    }
+    if (fd >= 0) close(fd);
+    if (mapping == MAP_FAILED) {
+        problem = "unable to open " + fileName;
+        return nullptr;
+    }
+    return (char*) mapping;
+}
+
+
+// Function to move an image written with relocation records to baseAddress, which must lie inside
+// the machine's memory. Every word the records name has its operand moved by the same amount, which
+// must leave the operand inside the machine: at least 0 and below both the opcode radix and the
+// memory size, so it never carries into the opcode. The words are checked before any is written, so
+// an image that cannot move is left as it was. They are then shifted in place; only when a shifted
+// word no longer fits in the image's 4-byte words is the image written again with 8-byte words.
+// Returns false, with the reason in problem, if the image or its records are missing or malformed
+// or the image cannot move there.
+bool rebaseImage(const string& fileName, int64_t baseAddress, string& problem) {
+    string recordFile = fileName + ".reloc";
+    size_t recordSize;
+    const char* recordData = mapFile(recordFile, false, recordSize, problem);
+    if (recordData == nullptr) return false;
+    RelocationsHeader recordHeader;
+    bool validRecords = recordSize >= sizeof(recordHeader);
+    if (validRecords) {
+        memcpy(&recordHeader, recordData, sizeof(recordHeader));
+        validRecords = memcmp(recordHeader.magic, relocationsMagic, sizeof(relocationsMagic)) == 0 && recordHeader.version == imageVersion
+                    && recordHeader.recordBytes == sizeof(uint64_t)
+                    && recordHeader.recordCount == (recordSize - sizeof(recordHeader)) / sizeof(uint64_t)
+                    && (recordSize - sizeof(recordHeader)) % sizeof(uint64_t) == 0;
+    }
+    size_t imageSize;
+    char* mapping = validRecords ? mapFile(fileName, true, imageSize, problem) : nullptr;
+    if (!validRecords) problem = "invalid relocation records " + recordFile;
+
+    // Function to release both mappings, returning result
+    auto finish = [&](bool result) {
+        munmap((void*) recordData, recordSize);
+        if (mapping) munmap(mapping, imageSize);
+        return result;
+    };
+    if (mapping == nullptr) return finish(false);
+
+    ImageHeader header;
+    bool validImage = imageSize >= sizeof(header);
+    if (validImage) {
+        memcpy(&header, mapping, sizeof(header));
+        validImage = memcmp(header.magic, imageMagic, sizeof(imageMagic)) == 0 && header.version == imageVersion
+                  && (header.wordBytes == 4 || header.wordBytes == 8) && header.opcodeRadix > 0 && header.memorySize > 0
+                  && header.baseAddress >= 0 && header.baseAddress < header.memorySize
+                  && header.wordCount == (imageSize - sizeof(header)) / header.wordBytes
+                  && (imageSize - sizeof(header)) % header.wordBytes == 0;
+    }
+    char* words = mapping + sizeof(header);
+
+    // Function to read the word at index
+    auto wordAt = [&](uint64_t index) {
+        if (header.wordBytes == 8) {
+            int64_t word;
+            memcpy(&word, words + index * 8, 8);
+            return word;
+        }
+        int32_t word;
+        memcpy(&word, words + index * 4, 4);
+        return (int64_t) word;
+    };
+
+    // Every record must name a word of the image, and that word an instruction, never negative
+    const char* records = recordData + sizeof(recordHeader);
+    for (uint64_t r = 0; validImage && r < recordHeader.recordCount; r++) {
+        uint64_t record;
+        memcpy(&record, records + r * sizeof(record), sizeof(record));
+        validImage = (record & recordIndexMask) < header.wordCount && wordAt(record & recordIndexMask) >= 0;
+    }
+    if (!validImage) {
+        problem = "invalid memory image " + fileName;
+        return finish(false);
+    }
+    if (baseAddress < 0 || baseAddress >= header.memorySize) {
+        problem = "base " + to_string(baseAddress) + " is outside the " + to_string(header.memorySize) + " words of memory of " + fileName;
+        return finish(false);
+    }
+
+    // Both bases lie in [0, memorySize), so their difference cannot overflow
+    int64_t shift = baseAddress - header.baseAddress;
+    int64_t operandLimit = min(header.opcodeRadix, header.memorySize);
+
+    // Function to return the index a record names and the word there once shifted, or false if
+    // the shifted operand leaves the machine
+    auto shifted = [&](uint64_t r, uint64_t& index, int64_t& word) {
+        uint64_t record;
+        memcpy(&record, records + r * sizeof(record), sizeof(record));
+        index = record & recordIndexMask;
+        word = wordAt(index);
+        int64_t operand = word % header.opcodeRadix;
+        if (shift < -operand || shift >= operandLimit - operand) return false;
+        word = word - operand + (operand + shift);
+        return true;
+    };
+
+    // Check every word first, and whether the shifted words still fit in 4 bytes
+    bool fits = true;
+    uint64_t index;
+    int64_t word;
+    for (uint64_t r = 0; r < recordHeader.recordCount; r++) {
+        if (!shifted(r, index, word)) {
+            problem = "word " + to_string(index) + " of " + fileName + " cannot move to base " + to_string(baseAddress)
+                    + ", its operand would leave the machine";
+            return finish(false);
+        }
+        fits = fits && (header.wordBytes == 8 || (word >= INT32_MIN && word <= INT32_MAX));
+    }
+    header.baseAddress = baseAddress;
+
+    // 4-byte words that would overflow are widened, by writing the image again
+    if (!fits) {
+        vector<int64_t> wideWords(header.wordCount);
+        for (uint64_t i = 0; i < header.wordCount; i++) wideWords[i] = wordAt(i);
+        for (uint64_t r = 0; r < recordHeader.recordCount; r++) {
+            shifted(r, index, word);
+            wideWords[index] = word;
+        }
+        munmap(mapping, imageSize);
+        mapping = nullptr;
+        header.wordBytes = 8;
+        return finish(writeWords(fileName, header, wideWords, problem));
+    }
+
+    for (uint64_t r = 0; r < recordHeader.recordCount; r++) {
+        shifted(r, index, word);
+        if (header.wordBytes == 8) {
+            memcpy(words + index * 8, &word, 8);
+        } else {
+            int32_t narrowWord = word;
+            memcpy(words + index * 4, &narrowWord, 4);
+        }
+    }
+    memcpy(mapping, &header, sizeof(header));
+    bool written = munmap(mapping, imageSize) == 0;
+    mapping = nullptr;
+    if (!written) problem = "unable to write " + fileName;
+    return finish(written);
+}
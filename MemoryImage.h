@@ -0,0 +1,92 @@
+#ifndef MEMORY_IMAGE_H
+#define MEMORY_IMAGE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class MachineModel;
+
+// Memory image format (--image <file>), all integers little endian:
+//   header   ImageHeader
+//   words    wordCount words of wordBytes bytes each, two's complement, the relocated word of
+//            every memory map index in order; 4-byte words when every word fits, 8 otherwise
+// Diagnostics go to a sidecar file, the image's name with ".diag" appended:
+//   header   DiagnosticsHeader
+//   records  one uint64 per memory map line carrying an error, in index order: the memory map
+//            index in the low 56 bits and the diagnostic code in the top 8
+// With --relocations the words that depend on where the program is loaded are listed in a second
+// sidecar, the image's name with ".reloc" appended:
+//   header   RelocationsHeader
+//   records  one uint64 per such word, in index order: the memory map index in the low 56 bits
+//            and the fixup kind in the top 8
+// Every fixup adds the same amount, the distance the image moves, so rebaseImage moves an image
+// in one pass over the records without linking again.
+// The listing keeps the symbol table and every warning; only the memory map lines move to the
+// image and their errors to the sidecar, and the listing leaves out the "Memory Map" heading.
+
+// Diagnostic codes of the sidecar, and the relocation outcome of an instruction in the second pass
+static const uint8_t relocationValid = 0;
+static const uint8_t illegalOpcode = 1;             // "Illegal opcode; treated as <largest instruction>"
+static const uint8_t illegalModuleOperand = 2;      // "Illegal module operand ; treated as module=0"
+static const uint8_t absoluteTooLarge = 3;          // "Absolute address exceeds machine size; zero used"
+static const uint8_t relativeTooLarge = 4;          // "Relative address exceeds module size; relative zero used"
+static const uint8_t illegalImmediate = 5;          // "Illegal immediate operand; treated as <largest operand>"
+static const uint8_t undefinedExternal = 6;         // "<symbol> is not defined; zero used"
+static const uint8_t externalTooLarge = 7;          // "External operand exceeds length of uselist; treated as relative=0"
+
+// Fixup kinds of the relocation records, after the addressing mode the word was relocated with.
+// An R word holds its module's base, an M word the base of the module it names and an E word the
+// address of a symbol, each of which moves with the image; so does the relative zero used for an
+// E operand past the use list. Words whose error left them without an address are not fixed up.
+static const uint8_t fixupNone = 0;
+static const uint8_t fixupRelative = 1;
+static const uint8_t fixupModule = 2;
+static const uint8_t fixupExternal = 3;
+
+// Class representing the header of a memory image
+class ImageHeader {
+public:
+    char magic[8];
+    uint32_t version;
+    uint32_t wordBytes;
+    uint64_t wordCount;
+    int64_t opcodeRadix;        // Of the machine the image was linked for
+    int64_t memorySize;         // Of the machine the image was linked for
+    int64_t baseAddress;        // Address the image is placed at, 0 as linked
+};
+
+// Class representing the header of a diagnostics sidecar
+class DiagnosticsHeader {
+public:
+    char magic[8];
+    uint32_t version;
+    uint32_t recordBytes;
+    uint64_t recordCount;
+};
+
+// Class representing the header of a relocation records sidecar
+class RelocationsHeader {
+public:
+    char magic[8];
+    uint32_t version;
+    uint32_t recordBytes;
+    uint64_t recordCount;
+};
+
+// Class holding a linked memory map as the second pass fills it in, one entry per memory map index
+class MemoryImage {
+public:
+    vector<int64_t> words;
+    vector<uint8_t> errors;     // Diagnostic code of each word, relocationValid for none
+    bool recordFixups = false;  // Whether fixups is filled, for the relocation records
+    vector<uint8_t> fixups;     // Fixup kind of each word, fixupNone for none
+};
+
+// All function prototypes required
+bool writeImage(const MemoryImage& image, const MachineModel& machine, const string& fileName, string& problem);
+bool rebaseImage(const string& fileName, int64_t baseAddress, string& problem);
+
+#endif // MEMORY_IMAGE_H
@@ -0,0 +1,224 @@
+#include "ObjectFormat.h"
+#include "Parser.h"
+#include "LinkContext.h"
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char objectMagic[8] = {'M', 'A', 'R', 'I', 'E', 'O', 'B', 'J'};
+static const uint32_t objectVersion = 2;
+static const char addressModes[] = "MARIE";
+
+// Instructions are stored as 61-bit two's complement values
+static const int64_t smallestInstruction = -(INT64_C(1) << 60);
+static const int64_t illegalInstruction = (INT64_C(1) << 60) - 1;
+
+
+// Function to check whether an input starts with the binary object magic
+bool isBinaryObject(const char* data, size_t size) {
+    return size >= sizeof(objectMagic) && memcmp(data, objectMagic, sizeof(objectMagic)) == 0;
+}
+
+
+// Function to load a binary object into modules. The layout is checked against the size of the
+// input; the checks the text parser performs (definition and use limits, symbol names, addressing
+// modes) are repeated and reported through parsed like parse errors. Returns false if the object
+// is corrupt.
+bool loadObject(const char* data, size_t size, const MachineModel& machine, ParsedRange& parsed) {
+    ObjectHeader header;
+    if (size < sizeof(header)) return false;
+    memcpy(&header, data, sizeof(header));
+    if (header.version != objectVersion) return false;
+    if (header.moduleCount > (size - sizeof(header)) / sizeof(ObjectModuleRecord)) return false;
+
+    parsed.modules.reserve(header.moduleCount);
+    Arena& arena = parsed.arena();
+    for (uint32_t m = 0; m < header.moduleCount; m++) {
+        ObjectModuleRecord record;
+        memcpy(&record, data + sizeof(header) + m * sizeof(record), sizeof(record));
+        if (record.dataOffset > size || record.dataLength > size - record.dataOffset) return false;
+        const char* cursor = data + record.dataOffset;
+        const char* end = cursor + record.dataLength;
+
+        ModuleIR module;
+        module.storage = parsed.storage;
+        module.instructionCount = record.instructionCount;
+        module.definitionCountLine = record.definitionCountLine;
+        module.definitionCountOffset = record.definitionCountOffset;
+        module.useCountLine = record.useCountLine;
+        module.useCountOffset = record.useCountOffset;
+        module.instructionCountLine = record.instructionCountLine;
+        module.instructionCountOffset = record.instructionCountOffset;
+
+        // Function to read one length-prefixed name, returns false if it runs past the module
+        auto readName = [&](string_view& name) {
+            if (cursor >= end || (uint8_t) *cursor > end - cursor - 1) return false;
+            name = string_view(cursor + 1, (uint8_t) *cursor);
+            cursor += 1 + name.size();
+            return true;
+        };
+
+        bool headerRead = false;
+        try {
+            Token countToken;
+            countToken.setToken(record.definitionCountLine, record.definitionCountOffset, "");
+            if (record.definitionCount > machine.maxDefinitions) __parseerror(4, countToken);
+            module.defList.reserve(arena, max(0, record.definitionCount));
+            for (int i = 0; i < record.definitionCount; i++) {
+                Definition definition;
+                Token nameToken = countToken;
+                if (!readName(nameToken.tokenContents) || end - cursor < 4) return false;
+                definition.value = arena.store(readSymbol(nameToken, machine));
+                memcpy(&definition.relativeAddr, cursor, 4);
+                cursor += 4;
+                module.defList.push_back(arena, definition);
+            }
+
+            countToken.setToken(record.useCountLine, record.useCountOffset, "");
+            if (record.useCount > machine.maxUses) __parseerror(5, countToken);
+            module.useList.reserve(arena, max(0, record.useCount));
+            for (int i = 0; i < record.useCount; i++) {
+                Token nameToken = countToken;
+                if (!readName(nameToken.tokenContents)) return false;
+                module.useList.push_back(arena, arena.store(readSymbol(nameToken, machine)));
+            }
+            headerRead = true;
+
+            // Instruction words start at the next multiple of 8 bytes
+            cursor += (8 - (cursor - data) % 8) % 8;
+            int instructionCount = max(0, record.instructionCount);
+            if (cursor > end || (end - cursor) / 8 < instructionCount) return false;
+            module.instructions.reserve(arena, instructionCount);
+            countToken.setToken(record.instructionCountLine, record.instructionCountOffset, "");
+            for (int i = 0; i < instructionCount; i++) {
+                uint64_t word;
+                memcpy(&word, cursor + 8 * i, 8);
+                uint64_t mode = word >> 61;
+                if (mode >= 5) __parseerror(2, countToken);
+                // Sign extend the 61-bit instruction
+                module.instructions.push_back(arena, addressModes[mode], (int64_t) (word << 3) >> 3);
+            }
+        } catch (const ParseError& error) {
+            parsed.failed = true;
+            parsed.failedInHeader = !headerRead;
+            parsed.error = error;
+            if (headerRead) parsed.modules.push_back(move(module));
+            return true;
+        }
+        parsed.modules.push_back(move(module));
+    }
+    return true;
+}
+
+
+// Function to encode modules as a binary object image. Fails if an instruction is too negative
+// to be stored in 61 bits.
+bool encodeObject(const vector<ModuleIR>& modules, vector<char>& image, string& problem) {
+    ObjectHeader header;
+    memcpy(header.magic, objectMagic, sizeof(objectMagic));
+    header.version = objectVersion;
+    header.moduleCount = modules.size();
+
+    image.assign(sizeof(header) + modules.size() * sizeof(ObjectModuleRecord), 0);
+    memcpy(image.data(), &header, sizeof(header));
+
+    // Function to append raw bytes to the image
+    auto put = [&](const void* bytes, size_t length) {
+        image.insert(image.end(), (const char*) bytes, (const char*) bytes + length);
+    };
+
+    for (size_t m = 0; m < modules.size(); m++) {
+        const ModuleIR& module = modules[m];
+        ObjectModuleRecord record;
+        record.dataOffset = image.size();
+        record.definitionCount = module.defList.size();
+        record.useCount = module.useList.size();
+        record.instructionCount = module.instructionCount;
+        record.definitionCountLine = module.definitionCountLine;
+        record.definitionCountOffset = module.definitionCountOffset;
+        record.useCountLine = module.useCountLine;
+        record.useCountOffset = module.useCountOffset;
+        record.instructionCountLine = module.instructionCountLine;
+        record.instructionCountOffset = module.instructionCountOffset;
+
+        for (const Definition& definition : module.defList) {
+            uint8_t length = definition.value.size();
+            int32_t relativeAddr = definition.relativeAddr;
+            put(&length, 1);
+            put(definition.value.data(), length);
+            put(&relativeAddr, 4);
+        }
+        for (string_view use : module.useList) {
+            uint8_t length = use.size();
+            put(&length, 1);
+            put(use.data(), length);
+        }
+        image.resize((image.size() + 7) / 8 * 8, 0);
+
+        for (size_t i = 0; i < module.instructions.size(); i++) {
+            int64_t instruction = module.instructions.words[i];
+            if (instruction < smallestInstruction) {
+                problem = "instruction " + to_string(instruction) + " in module " + to_string(m) + " cannot be stored";
+                return false;
+            }
+            int64_t address = min(instruction, illegalInstruction);
+            uint64_t mode = strchr(addressModes, module.instructions.modes[i]) - addressModes;
+            uint64_t word = (mode << 61) | ((uint64_t) address & ((UINT64_C(1) << 61) - 1));
+            put(&word, 8);
+        }
+
+        record.dataLength = image.size() - record.dataOffset;
+        memcpy(image.data() + sizeof(header) + m * sizeof(record), &record, sizeof(record));
+    }
+    return true;
+}
+
+
+// Function to write an image to a file, replacing its contents
+bool writeFile(const string& fileName, const vector<char>& image, string& problem) {
+    int fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool written = fd >= 0 && writeAll(fd, image.data(), image.size());
+    if (fd >= 0) written = close(fd) == 0 && written;
+    if (!written) problem = "unable to write " + fileName;
+    return written;
+}
+
+
+// Function to write modules as a binary object. Fails if the file cannot be written or an
+// instruction is too negative to be stored in 61 bits.
+bool writeObject(const vector<ModuleIR>& modules, const string& fileName, string& problem) {
+    vector<char> image;
+    return encodeObject(modules, image, problem) && writeFile(fileName, image, problem);
+}
+
+
+// Function to convert an object file (text or binary) into a binary object. Parse errors are
+// reported as the linker reports them. Returns the exit status for the command line.
+int convertObject(const string& inputName, const string& outputName, const MachineModel& machine, OutputBuffer& out) {
+    Tokenizer tokenizer;
+    if (!tokenizer.openFile(inputName)) {
+        out.append("Unable to open file " + inputName + "\n");
+        return 1;
+    }
+
+    LinkContext context(machine);
+    ParsedRange parsed;
+    if (!readModules(context, tokenizer, parsed)) {
+        out.append("Invalid object file " + inputName + "\n");
+        return 1;
+    }
+    if (parsed.failed) {
+        out.append(parsed.error.message());
+        out.append('\n');
+        return 1;
+    }
+
+    string problem;
+    if (!writeObject(parsed.modules, outputName, problem)) {
+        out.append("Unable to convert " + inputName + ": " + problem + "\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef OBJECT_FORMAT_H
+#define OBJECT_FORMAT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Token.h"
+
+using namespace std;
+
+class ParsedRange;
+class OutputBuffer;
+class MachineModel;
+
+// Binary object format, all integers little endian:
+//   header        ObjectHeader
+//   module table  one ObjectModuleRecord per module
+//   module data   per module: definitions (uint8 name length, name, int32 relative address),
+//                 uses (uint8 name length, name), zero padding to a multiple of 8 bytes, and one
+//                 uint64 word per instruction
+// An instruction word holds the addressing mode (0..4 for M, A, R, I, E) in its top three bits and
+// the instruction (opcode * radix + operand) as a 61-bit two's complement value. Machine models
+// keep every legal instruction below 2^60 - 1, so larger (illegal) values are stored as 2^60 - 1.
+
+// Class representing the header of a binary object
+class ObjectHeader {
+public:
+    char magic[8];
+    uint32_t version;
+    uint32_t moduleCount;
+};
+
+// Class representing one entry of the module table. The token positions of the original text are
+// kept so that errors found when loading are reported where the text linker reports them.
+class ObjectModuleRecord {
+public:
+    uint64_t dataOffset;
+    uint32_t dataLength;
+    int32_t definitionCount;
+    int32_t useCount;
+    int32_t instructionCount;
+    int32_t definitionCountLine;
+    int32_t definitionCountOffset;
+    int32_t useCountLine;
+    int32_t useCountOffset;
+    int32_t instructionCountLine;
+    int32_t instructionCountOffset;
+};
+
+// All function prototypes required
+bool isBinaryObject(const char* data, size_t size);
+bool loadObject(const char* data, size_t size, const MachineModel& machine, ParsedRange& parsed);
+bool encodeObject(const vector<ModuleIR>& modules, vector<char>& image, string& problem);
+bool writeFile(const string& fileName, const vector<char>& image, string& problem);
+bool writeObject(const vector<ModuleIR>& modules, const string& fileName, string& problem);
+int convertObject(const string& inputName, const string& outputName, const MachineModel& machine, OutputBuffer& out);
+
+#endif // OBJECT_FORMAT_H
@@ -0,0 +1,214 @@
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string_view>
+#include <vector>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+// Function to write all of data to fd, retrying partial and interrupted writes
+inline bool writeAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+
+// Class implementing a byte buffer the linker formats its output into. Numbers are converted by
+// hand instead of through iostreams. A buffer attached to a file descriptor writes itself out in
+// large chunks whenever it fills up; a detached buffer (fd -1) just grows and is handed to an
+// OutputSink or read back with view().
+class OutputBuffer {
+private:
+    vector<char> buffer;
+    size_t used = 0;
+    int fd;
+    uint64_t written = 0;   // Bytes written to fd so far
+
+    // Function to make room for at least length more bytes
+    void reserve(size_t length) {
+        if (used + length <= buffer.size()) return;
+        if (fd >= 0) flush();
+        if (used + length > buffer.size()) buffer.resize(max(buffer.size() * 2, used + length));
+    }
+
+public:
+    explicit OutputBuffer(int fd = -1, size_t capacity = 1 << 20) : buffer(capacity), fd(fd) {}
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void append(char c) {
+        reserve(1);
+        buffer[used++] = c;
+    }
+
+    void append(string_view text) {
+        reserve(text.size());
+        memcpy(buffer.data() + used, text.data(), text.size());
+        used += text.size();
+    }
+
+    // Function to append a decimal number, left padded with '0' to width characters.
+    // The padding goes before the sign, as setfill('0') << setw(width) does.
+    void appendNumber(long long value, int width = 0) {
+        char digits[24];
+        char* start = digits + sizeof(digits);
+        unsigned long long magnitude = value < 0 ? 0ULL - value : value;
+        do {
+            *--start = '0' + magnitude % 10;
+            magnitude /= 10;
+        } while (magnitude > 0);
+        if (value < 0) *--start = '-';
+
+        int length = digits + sizeof(digits) - start;
+        reserve(max(length, width));
+        for (int i = length; i < width; i++) buffer[used++] = '0';
+        memcpy(buffer.data() + used, start, length);
+        used += length;
+    }
+
+    // Function to append one memory map entry, "NNN: DDDD" with the default widths
+    void appendEntry(int64_t index, int64_t address, int indexWidth = 3, int addressWidth = 4) {
+        reserve(32);
+        // Fast path for the common case of small non-negative values at the default widths
+        if (indexWidth == 3 && addressWidth == 4 && index >= 0 && index < 1000 && address >= 0 && address < 10000) {
+            char* out = buffer.data() + used;
+            out[0] = '0' + index / 100;
+            out[1] = '0' + index / 10 % 10;
+            out[2] = '0' + index % 10;
+            out[3] = ':';
+            out[4] = ' ';
+            out[5] = '0' + address / 1000;
+            out[6] = '0' + address / 100 % 10;
+            out[7] = '0' + address / 10 % 10;
+            out[8] = '0' + address % 10;
+            used += 9;
+            return;
+        }
+        appendNumber(index, indexWidth);
+        append(": ");
+        appendNumber(address, addressWidth);
+    }
+
+    // Function to write the buffered bytes to the file descriptor
+    void flush() {
+        if (fd >= 0 && used > 0) writeAll(fd, buffer.data(), used);
+        if (fd >= 0) written += used, used = 0;
+    }
+
+    // Function to take the contents of a detached buffer, leaving it empty
+    vector<char> release() {
+        buffer.resize(used);
+        vector<char> contents = move(buffer);
+        buffer.clear();
+        used = 0;
+        return contents;
+    }
+
+    // Function to empty a detached buffer, keeping its capacity
+    void clear() {
+        used = 0;
+    }
+
+    string_view view() const {
+        return string_view(buffer.data(), used);
+    }
+
+    size_t size() const {
+        return used;
+    }
+
+    int descriptor() const {
+        return fd;
+    }
+
+    // Function to count bytes written to the file descriptor past the buffer
+    void recordWritten(size_t length) {
+        written += length;
+    }
+
+    uint64_t bytesWritten() const {
+        return written;
+    }
+
+    ~OutputBuffer() {
+        flush();
+    }
+};
+
+
+// Class implementing a sink shared by several threads. Each thread formats a numbered piece of
+// the output into its own buffer and submits it; pieces reach the target buffer in sequence order
+// as soon as every piece before them has arrived. When the target is attached to a file
+// descriptor, the pieces bypass it and are written several at a time with writev.
+class OutputSink {
+private:
+    OutputBuffer& target;
+    mutex sinkMutex;
+    map<size_t, vector<char>> pending;  // Submitted pieces waiting for an earlier one
+    size_t nextSequence = 0;            // Number of the next piece to write
+
+public:
+    explicit OutputSink(OutputBuffer& target) : target(target) {}
+
+    void submit(size_t sequence, vector<char> piece) {
+        lock_guard<mutex> lock(sinkMutex);
+        pending.emplace(sequence, move(piece));
+
+        // Gather the run of consecutive pieces that is now complete
+        vector<iovec> ready;
+        auto it = pending.begin();
+        while (it != pending.end() && it -> first == nextSequence) {
+            if (!it -> second.empty()) ready.push_back({it -> second.data(), it -> second.size()});
+            nextSequence++;
+            it++;
+        }
+
+        if (target.descriptor() < 0) {
+            for (iovec& entry : ready) target.append(string_view((const char*) entry.iov_base, entry.iov_len));
+            pending.erase(pending.begin(), it);
+            return;
+        }
+
+        // Anything already buffered goes first; writev takes at most IOV_MAX entries and may
+        // write only part of them
+        int fd = target.descriptor();
+        target.flush();
+        size_t done = 0;
+        while (done < ready.size()) {
+            int count = min<size_t>(ready.size() - done, 1024);
+            ssize_t written = writev(fd, ready.data() + done, count);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            target.recordWritten(written);
+            while (done < ready.size() && written >= (ssize_t) ready[done].iov_len) {
+                written -= ready[done].iov_len;
+                done++;
+            }
+            if (written > 0) {
+                ready[done].iov_base = (char*) ready[done].iov_base + written;
+                ready[done].iov_len -= written;
+            }
+        }
+        pending.erase(pending.begin(), it);
+    }
+};
+
+#endif // OUTPUT_BUFFER_H
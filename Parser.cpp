@@ -1,20 +1,32 @@
 #include "Parser.h" 
-#include <iostream> 
-#include <iomanip>  
-#include <fstream>  
 #include <vector>   
 #include <cctype>   
 #include <string>   
 #include <cstring>  
 #include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include "ThreadPool.h"
+#include "ObjectFormat.h"
+#include "LinkCache.h"
+#include "Library.h"
+#include "MachineModel.h"
+#include "Stats.h"
+#include "LinkContext.h"
+#include "InputCache.h"
+#include "Scan.h"
+#include "SpscQueue.h"
+#include "ConcurrentSymbolTable.h"
+#include "MemoryImage.h"
+#include <climits>
+#include <map>
+#include <thread>
+#include <unordered_set>
 
 using namespace std;
 
-vector<Module> module_base; // Vector to store the module_base table
-
-
-// Function to handle parse errors
-void __parseerror(int errcode, Token token) {
+// Function to describe a parse error the way it is reported to the user
+string ParseError::message() const {
     static const char* errors[] = {
         "NUM_EXPECTED",            
         "SYM_EXPECTED",            
@@ -24,514 +36,1298 @@ void __parseerror(int errcode, Token token) {
         "TOO_MANY_USE_IN_MODULE",  
         "TOO_MANY_INSTR",          
     };
-    cout << "Parse Error line " << token.lineNumber << " offset " << token.lineOffset << ": " << errors[errcode] << endl;
-    exit(1);
+    string location = fileName.empty() ? "" : "in " + fileName + " ";
+    return "Parse Error " + location + "line " + to_string(lineNumber) + " offset " + to_string(lineOffset) + ": " + errors[errcode];
+}
+
+
+// Function to handle parse errors, the error is thrown to the caller of the pass
+void __parseerror(int errcode, Token token, int fileIndex) {
+    ParseError error;
+    error.errcode = errcode;
+    error.lineNumber = token.lineNumber;
+    error.lineOffset = token.lineOffset;
+    error.fileIndex = fileIndex;
+    throw error;
 }
 
 
-// Function to read an integer from a token, with error handling for invalid or out-of-range inputs
+// Function to read an integer from a token, with error handling for invalid or out-of-range inputs.
+// Accepts what stoi accepts: an optional sign and the digits up to the first other character.
 int readInteger(Token token) {
-    try {
-        return stoi(token.tokenContents);
-    } catch(const invalid_argument& e) {
-        __parseerror(0, token);
-    } catch(const out_of_range& e) {
-        __parseerror(0, token);
-    }
-    return 0;
+    int64_t value;
+    if (!parseDecimal(token.tokenContents, INT_MIN, INT_MAX, value)) __parseerror(0, token);
+    return value;
+}
+
+
+// Function to read an instruction from a token. Instructions are read as int like every other
+// integer unless the machine model needs wider values.
+int64_t readAddress(Token token, const MachineModel& machine) {
+    if (!machine.wideInstructions()) return readInteger(token);
+    int64_t value;
+    if (!parseDecimal(token.tokenContents, INT64_MIN, INT64_MAX, value)) __parseerror(0, token);
+    return value;
 }
 
 
 // Function to read and validate a MARIE symbol from a token
-string readMARIE(Token token) {
-    string currentSymbol = token.tokenContents;
-    if (currentSymbol.length() > 1 || (
-        currentSymbol[0] != 'M' && 
-        currentSymbol[0] != 'A' && 
-        currentSymbol[0] != 'R' && 
-        currentSymbol[0] != 'I' && 
-        currentSymbol[0] != 'E')) {
+char readMARIE(Token token) {
+    string_view text = token.tokenContents;
+    bool valid = text.size() == 1 && (text[0] == 'M' || text[0] == 'A' || text[0] == 'R' || text[0] == 'I' || text[0] == 'E');
+    if (!valid) {
         __parseerror(2, token); // Error if not a valid MARIE symbol
     }
-    return currentSymbol;
+    return text[0];
 }
 
 
-// Function to read and validate a symbol from a token
-string readSymbol(Token token) {
-    string currentSymbol = token.tokenContents;
-    if (currentSymbol.empty()) {
+// Function to read and validate a symbol from a token. The symbol is a view of the token.
+string_view readSymbol(Token token, const MachineModel& machine) {
+    string_view text = token.tokenContents;
+    if (text.empty()) {
         __parseerror(1, token);
     }
 
-    // Check first character is alphabetic and remaining characters are alphanumeric
-    for (int i = 0; currentSymbol[i]; i++) {
-        if ((i == 0 && !isalpha(currentSymbol[i])) || !isalnum(currentSymbol[i])) 
-            __parseerror(1, token);
+    // Check first character is alphabetic and remaining characters are alphanumeric. As with the
+    // C string the check was written for, a NUL character ends the part that is checked.
+    size_t checked = alphanumericPrefix(text);
+    if ((text[0] != '\0' && !isAsciiLetter(text[0])) || (checked < text.size() && text[checked] != '\0')) {
+        __parseerror(1, token);
     }
 
-    // Error if symbol length exceeds 16 characters
-    if (currentSymbol.size() > 16) {
+    // Error if symbol length exceeds the machine's limit (16 characters)
+    if (text.size() > machine.maxSymbolLength) {
         __parseerror(3, token);
     }
-    return currentSymbol;
+    return text;
 }
 
 
-// Function representing the first pass of the two-pass linker, processes definitions and uses
-vector<Symbol> firstPass(string fileName) {
-    // Create a tokenizer object
-    Tokenizer tokenizer;
-    // Exit if file cannot be opened
-    if (!tokenizer.openFile(fileName)) { // Attempt to open the specified file
-        cout << "Unable to open file " << fileName << endl;
-        exit(0);
+// Function to read the definitions, uses and instruction count of one module into arena.
+// Definitions are recorded with their relative address, base addresses are assigned later.
+// An error is reported at the token that caused it, which the tokenizer already holds.
+static void parseModuleHeader(const MachineModel& machine, Tokenizer& tokenizer, Token& currentToken, ModuleIR& module, Arena& arena) {
+    // Read the definition count, error if it exceeds the machine's limit (16)
+    int definitionCount = readInteger(currentToken);
+    module.definitionCountLine = currentToken.lineNumber;
+    module.definitionCountOffset = currentToken.lineOffset;
+    if (definitionCount > machine.maxDefinitions) {
+        __parseerror(4, currentToken);
     }
+    currentToken = tokenizer.getNextToken();
 
-    string line;
-    int totalInstructions = 0;
-
-    vector<Symbol> symbols;     // Vector to store distinct symbols found in the first pass 
-    vector<Symbol> defList;     // Vector to store all symbol definitions
+    // Process each definition
+    module.defList.reserve(arena, max(0, definitionCount));
+    for (int i = 0; i < definitionCount; i++) {
+        Definition definition;
+        // Read the symbol and its address, moving to the next token after each
+        definition.value = arena.store(readSymbol(currentToken, machine));
+        currentToken = tokenizer.getNextToken();
+        definition.relativeAddr = readInteger(currentToken);
+        currentToken = tokenizer.getNextToken();
+        module.defList.push_back(arena, definition);
+    }
 
-    int baseAddress = 0;        // Starting address for the current module
-    int moduleNumber = 0;       // Counter for the current module number
+    // Read the use count, error if it exceeds the machine's limit (16)
+    int useCount = readInteger(currentToken);
+    module.useCountLine = currentToken.lineNumber;
+    module.useCountOffset = currentToken.lineOffset;
+    if (useCount > machine.maxUses) {
+        __parseerror(5, currentToken);
+    }
+    currentToken = tokenizer.getNextToken();
     
+    // Record the uses, they are resolved in the second pass
+    module.useList.reserve(arena, max(0, useCount));
+    for (int i = 0; i < useCount; i++) {
+        module.useList.push_back(arena, arena.store(readSymbol(currentToken, machine)));
+        currentToken = tokenizer.getNextToken();
+    }
+
+    // Read the instruction count for the current module
+    module.instructionCount = readInteger(currentToken);
+    module.instructionCountLine = currentToken.lineNumber;
+    module.instructionCountOffset = currentToken.lineOffset;
+    currentToken = tokenizer.getNextToken();
+}
+
+
+// Largest number of instructions room is made for before any is read. The count comes from the
+// input, so the room is also limited by what the rest of the input can hold.
+static const int instructionReservation = 1 << 16;
+
+
+// Function to return where a token starts in the input, the end of the input for the EOF token
+static const char* tokenPosition(const Tokenizer& tokenizer, const Token& token) {
+    return token.tokenContents.empty() ? tokenizer.inputEnd() : token.tokenContents.data();
+}
+
+
+// Function to read count instructions into instructions, stored in arena. Without a store the
+// instructions are only checked.
+static void readInstructions(const MachineModel& machine, Tokenizer& tokenizer, Token& currentToken, int count,
+                             InstructionStore* instructions, Arena& arena) {
+    if (instructions) {
+        // Every instruction takes two tokens and the separators after them, four bytes at least
+        size_t remaining = tokenizer.inputEnd() - tokenPosition(tokenizer, currentToken);
+        instructions -> reserve(arena, min<size_t>({(size_t) max(0, count), remaining / 4 + 1, instructionReservation}));
+    }
+    for (int i = 0; i < count; i++) {
+        // Read each instruction type and operand, moving to the next token after each
+        char addressMode = readMARIE(currentToken);
+        currentToken = tokenizer.getNextToken();
+        int64_t address = readAddress(currentToken, machine);
+        currentToken = tokenizer.getNextToken();
+        if (instructions) instructions -> push_back(arena, addressMode, address);
+    }
+}
+
+
+// Function to read the instructions of one module into arena, they are relocated in the second
+// pass. With skim they are only checked and the module keeps their text, to be read again then.
+static void parseModuleInstructions(const MachineModel& machine, Tokenizer& tokenizer, Token& currentToken, ModuleIR& module,
+                                    Arena& arena, bool skim) {
+    const char* start = tokenPosition(tokenizer, currentToken);
+    readInstructions(machine, tokenizer, currentToken, module.instructionCount, skim ? nullptr : &module.instructions, arena);
+    if (skim) module.instructionText = string_view(start, tokenPosition(tokenizer, currentToken) - start);
+}
+
+
+// Function to return the instructions of a module, reading them again into arena when the first
+// pass only checked them. The text was checked, so reading it again cannot fail.
+InstructionStore moduleInstructions(const MachineModel& machine, const ModuleIR& module, Arena& arena) {
+    if (module.instructionsStored()) return module.instructions;
+    InstructionStore instructions;
+    Tokenizer tokenizer;
+    tokenizer.openBuffer(module.instructionText.data(), module.instructionText.data() + module.instructionText.size());
+    Token currentToken = tokenizer.getNextToken();
+    readInstructions(machine, tokenizer, currentToken, module.instructionCount, &instructions, arena);
+    return instructions;
+}
+
+
+// Function to parse whole modules from the tokenizer's position until the next module would start
+// at or after limit, the end of the input or a parse error. At most maxModules modules are read.
+// With stopOnTooManyInstructions the range also ends as soon as its modules exceed the machine size,
+// which is only meaningful for a range starting at the beginning of the input. With a link cache,
+// modules the cache recognises are restored instead of parsed, and the others are recorded in it.
+// A streaming link without a cache only checks the instructions, see parseModuleInstructions.
+static void parseRange(LinkContext& context, Tokenizer& tokenizer, const char* limit, ParsedRange& range,
+                       size_t maxModules = SIZE_MAX, bool stopOnTooManyInstructions = false, LinkCache* cache = nullptr) {
+    const MachineModel& machine = context.machine;
+    Arena& arena = range.arena();
+    bool skim = context.streaming && cache == nullptr;
+    int64_t totalInstructions = 0;
     Token currentToken = tokenizer.getNextToken();  // Get the first token
-    while (!currentToken.tokenContents.empty()) {   // Continue until there are no more tokens
-        moduleNumber++;
-        // Number of definitions in the current module
-        int definitionCount;
+    // Continue until there are no more tokens
+    while (!currentToken.tokenContents.empty() && currentToken.tokenContents.data() < limit && range.modules.size() < maxModules) {
+        ModuleIR module;
+        const char* start = currentToken.tokenContents.data();
+        range.moduleStarts.push_back(start);
 
-        // Read the definition count and move to the next token
-        try {     
-            definitionCount = readInteger(currentToken);
-        } catch(exception E) {
-            Token lastToken = tokenizer.getLastToken();
-            __parseerror(0, lastToken);
+        // Restore an unchanged module from the cache and continue after its text
+        int entry = cache ? cache -> match(start, tokenizer.inputEnd()) : -1;
+        if (entry != -1) {
+            int endLine;
+            const char* end = cache -> restore(entry, start, currentToken.lineNumber, currentToken.lineOffset, module, endLine);
+            range.modules.push_back(move(module));
+            totalInstructions += range.modules.back().instructionCount;
+            if (stopOnTooManyInstructions && totalInstructions > machine.memorySize) break;
+            tokenizer.seek(end, endLine);
+            currentToken = tokenizer.getNextToken();
+            continue;
         }
 
-        // Error if the number of definitions exceeds 16
-        if (definitionCount > 16) {
-            __parseerror(4, currentToken);
+        Token firstToken = currentToken;
+        module.storage = range.storage;
+        try {
+            parseModuleHeader(machine, tokenizer, currentToken, module, arena);
+        } catch (const ParseError& error) {
+            range.failed = range.failedInHeader = true;
+            range.error = error;
+            range.errorPosition = tokenPosition(tokenizer, currentToken);
+            break;
         }
-        currentToken = tokenizer.getNextToken();
+        range.modules.push_back(move(module));
+        totalInstructions += range.modules.back().instructionCount;
+        if (stopOnTooManyInstructions && totalInstructions > machine.memorySize) break;
 
-        // Process each definition
-        for (int i = 0; i < definitionCount; i++) {
-            Symbol currentSymbol;
-            // Read the symbol and move to the next token
-            try {
-                currentSymbol.value = readSymbol(currentToken);
-                currentToken = tokenizer.getNextToken();
-            }
-            catch(exception E) {
-                Token lastToken = tokenizer.getLastToken();
-                __parseerror(1, lastToken);
-            }
+        try {
+            parseModuleInstructions(machine, tokenizer, currentToken, range.modules.back(), arena, skim);
+        } catch (const ParseError& error) {
+            range.failed = true;
+            range.error = error;
+            range.errorPosition = tokenPosition(tokenizer, currentToken);
+            break;
+        }
+        if (cache) cache -> record(range.modules.back(), start, tokenPosition(tokenizer, currentToken), firstToken.lineNumber, firstToken.lineOffset);
+    }
+    range.end = tokenPosition(tokenizer, currentToken);
+    if (context.stats.enabled) context.stats.tokens += tokenizer.tokensRead;
+}
 
-            // Read the symbol address, add the base address, and move to the next token
-            try {
-                currentSymbol.relativeAddr = readInteger(currentToken);
-                currentSymbol.Addr = currentSymbol.relativeAddr + baseAddress;
-                currentSymbol.moduleNumber = moduleNumber;
-                currentToken = tokenizer.getNextToken();
-            }
-            catch(exception E) {
-                Token lastToken = tokenizer.getLastToken();
-                __parseerror(0, lastToken);   
-            }
 
-            // Check if the symbol is already defined
-            bool flag = false;
-            for (int j = 0; j < symbols.size(); j++) {
-                if (symbols[j].value.compare(currentSymbol.value) == 0) {
-                    symbols[j].alreadyDefined = true;
-                    flag = true;
-                }
-            }
-            // If the symbol is not already defined, add it to the symbols vector
-            if (!flag) symbols.push_back(currentSymbol);
-
-            // Update the defList similarly
-            flag = false;
-            for (int j = 0; j < defList.size(); j++) {
-                if (defList[j].value.compare(currentSymbol.value) == 0) {
-                    flag = true;
-                    break;
+// Number of consecutive modules a resynchronization guess has to parse cleanly to be accepted
+static const int resyncModules = 4;
+
+
+// Function to guess the first module start in [from, to). Token starts are tried in turn and the
+// first one from which a few modules parse without error is taken. The guess is only speculative:
+// it is confirmed when the chunk before it ends exactly there. Returns nullptr if nothing fits.
+static const char* resynchronize(LinkContext& context, const Tokenizer& input, const char* from, const char* to) {
+    const char* cursor = from;
+
+    // Skip the rest of a token cut by the chunk boundary
+    if (cursor > input.inputBegin()) {
+        while (cursor < to && !isSeparator(cursor[-1])) cursor++;
+    }
+    for (int attempt = 0; attempt < 256 && cursor < to; attempt++) {
+        while (cursor < to && isSeparator(*cursor)) cursor++;
+        if (cursor >= to) break;
+
+        // A module starts with its definition count
+        if (isdigit((unsigned char) *cursor) || *cursor == '-' || *cursor == '+') {
+            Tokenizer trial;
+            trial.openBuffer(input.inputBegin(), input.inputEnd());
+            trial.seek(cursor, 1);
+            ParsedRange range;
+            parseRange(context, trial, input.inputEnd(), range, resyncModules);
+            if (!range.failed) return cursor;
+        }
+        while (cursor < to && !isSeparator(*cursor)) cursor++;
+    }
+    return nullptr;
+}
+
+
+// Function to append the modules of a range from index first on, returns false if the range failed
+static bool appendRange(ParsedRange& range, size_t first, ParsedRange& result) {
+    for (size_t m = first; m < range.modules.size(); m++) result.modules.push_back(move(range.modules[m]));
+    if (range.failed) {
+        result.failed = true;
+        result.failedInHeader = range.failedInHeader;
+        result.error = range.error;
+        result.errorPosition = range.errorPosition;
+    }
+    return !range.failed;
+}
+
+
+// Function to parse the input on several threads. The input is cut into chunks, each chunk is
+// resynchronized to a guessed module start and parsed on its own, and the chunks are stitched
+// back in order. Parsing is deterministic from a module start, so a chunk is trusted from the
+// first of its modules that starts exactly on a true module boundary; the input between true
+// boundaries and such a module is parsed serially. A wrong guess usually realigns with the true
+// module boundaries within a module or two, so little work is redone. The result is the same as
+// parsing the whole input in one range.
+static void parseParallel(LinkContext& context, const Tokenizer& input, int threadCount, ParsedRange& result) {
+    const char* begin = input.inputBegin();
+    const char* end = input.inputEnd();
+    size_t size = end - begin;
+    int chunkCount = min<size_t>(threadCount * 4, size / context.parallelChunkSize);
+
+    // Nominal chunk boundaries and the number of lines before each of them
+    vector<const char*> boundaries(chunkCount + 1);
+    for (int k = 0; k <= chunkCount; k++) boundaries[k] = begin + size * k / chunkCount;
+    vector<int> newlines(chunkCount + 1, 0);
+    vector<const char*> starts(chunkCount, end);
+
+    ThreadPool pool(threadCount);
+    for (int k = 0; k < chunkCount; k++) {
+        pool.submit([&, k] {
+            newlines[k + 1] = count(boundaries[k], boundaries[k + 1], '\n');
+            starts[k] = k == 0 ? begin : resynchronize(context, input, boundaries[k], boundaries[k + 1]);
+        });
+    }
+    pool.wait();
+    for (int k = 0; k < chunkCount; k++) newlines[k + 1] += newlines[k];
+
+    // Function to return the line number of a position in the input
+    auto lineAt = [&](const char* position) {
+        int k = upper_bound(boundaries.begin(), boundaries.end() - 1, position) - boundaries.begin() - 1;
+        return newlines[k] + (int) count(boundaries[k], position, '\n') + 1;
+    };
+
+    // Chunks without a plausible module start are merged into the chunk before them
+    vector<const char*> chunkStarts;
+    for (int k = 0; k < chunkCount; k++) {
+        if (starts[k] != nullptr) chunkStarts.push_back(starts[k]);
+    }
+    int chunks = chunkStarts.size();
+    vector<ParsedRange> ranges(chunks);
+
+    for (int index = 0; index < chunks; index++) {
+        pool.submit([&, index] {
+            TraceScope trace(context.stats, "parse chunk");
+            Tokenizer tokenizer;
+            tokenizer.openBuffer(begin, end);
+            if (index > 0) tokenizer.seek(chunkStarts[index], lineAt(chunkStarts[index]));
+            parseRange(context, tokenizer, index + 1 < chunks ? chunkStarts[index + 1] : end, ranges[index]);
+        });
+    }
+    pool.wait();
+
+    // Stitch the chunks in order. The first chunk starts at the beginning of the input and is exact.
+    if (!appendRange(ranges[0], 0, result)) return;
+    const char* next = ranges[0].end;   // The next true module boundary
+    int index = 0;
+    while (next != end) {
+        // Skip chunks whose modules all start before the boundary
+        while (index < chunks && (ranges[index].moduleStarts.empty() || ranges[index].moduleStarts.back() < next)) index++;
+
+        ParsedRange serial;
+        Tokenizer tokenizer;
+        tokenizer.openBuffer(begin, end);
+        if (index == chunks) {
+            // No chunk left to realign with, parse the rest serially
+            tokenizer.seek(next, lineAt(next));
+            parseRange(context, tokenizer, end, serial);
+            appendRange(serial, 0, result);
+            return;
+        }
+
+        ParsedRange& range = ranges[index];
+        auto aligned = lower_bound(range.moduleStarts.begin(), range.moduleStarts.end(), next);
+        if (*aligned == next) {
+            // The chunk passed through the boundary, its modules from there on are exact
+            if (!appendRange(range, aligned - range.moduleStarts.begin(), result)) return;
+            next = range.end;
+            index++;
+        } else {
+            // Parse serially up to the chunk's next module start and check again
+            tokenizer.seek(next, lineAt(next));
+            parseRange(context, tokenizer, *aligned, serial);
+            if (!appendRange(serial, 0, result)) return;
+            next = serial.end;
+        }
+    }
+}
+
+
+// Function to find where parsing resumes after a parse error with --keep-going: the first token
+// after the one at errorPosition from which a whole module parses. Returns nullptr if none does.
+static const char* resumePosition(LinkContext& context, const Tokenizer& input, const char* errorPosition) {
+    const char* end = input.inputEnd();
+    const char* cursor = findSeparator(errorPosition, end);
+    while (true) {
+        while (cursor < end && isSeparator(*cursor)) cursor++;
+        if (cursor == end) return nullptr;
+
+        // A module starts with its definition count
+        if (isdigit((unsigned char) *cursor) || *cursor == '-' || *cursor == '+') {
+            Tokenizer trial;
+            trial.openBuffer(input.inputBegin(), end);
+            trial.seek(cursor, 1);
+            ParsedRange range;
+            parseRange(context, trial, end, range, 1);
+            if (!range.failed) return cursor;
+        }
+        cursor = findSeparator(cursor, end);
+    }
+}
+
+
+// Function to parse on after the error that ended a parse, for --keep-going. Parsing resumes at
+// the next module start after each error and every further error is recorded; the modules read
+// on the way are kept, so the machine size is still checked across them.
+static void parseAfterErrors(LinkContext& context, const Tokenizer& input, ParsedRange& parsed) {
+    const char* errorPosition = parsed.errorPosition;
+    int errorLine = parsed.error.lineNumber;
+    while (errorPosition != input.inputEnd()) {
+        const char* start = resumePosition(context, input, errorPosition);
+        if (start == nullptr) return;
+
+        Tokenizer tokenizer;
+        tokenizer.openBuffer(input.inputBegin(), input.inputEnd());
+        tokenizer.seek(start, errorLine + (int) count(errorPosition, start, '\n'));
+        ParsedRange range;
+        parseRange(context, tokenizer, input.inputEnd(), range);
+        for (ModuleIR& module : range.modules) parsed.modules.push_back(move(module));
+        if (!range.failed) return;
+        parsed.laterErrors.push_back(range.error);
+        errorPosition = range.errorPosition;
+        errorLine = range.error.lineNumber;
+    }
+}
+
+
+// Function to read every module of an opened input without linking it. Binary objects are loaded
+// directly, text objects are parsed (in parallel chunks for large inputs when threadCount > 1, or
+// module by module through the link cache when one is given). With --keep-going a text object is
+// parsed on past its errors.
+// Returns false if the input is a binary object with a corrupt layout.
+bool readModules(LinkContext& context, const Tokenizer& input, ParsedRange& parsed, int threadCount, bool stopOnTooManyInstructions,
+                 LinkCache* cache) {
+    const char* begin = input.inputBegin();
+    size_t inputSize = input.inputEnd() - begin;
+    if (isBinaryObject(begin, inputSize)) return loadObject(begin, inputSize, context.machine, parsed);
+
+    Tokenizer tokenizer;
+    tokenizer.openBuffer(begin, input.inputEnd());
+    if (threadCount > 1 && inputSize >= 2 * context.parallelChunkSize && cache == nullptr) {
+        parseParallel(context, tokenizer, threadCount, parsed);
+    } else {
+        parseRange(context, tokenizer, tokenizer.inputEnd(), parsed, SIZE_MAX, stopOnTooManyInstructions, cache);
+    }
+    if (context.keepGoing && parsed.failed) parseAfterErrors(context, tokenizer, parsed);
+    return true;
+}
+
+
+// Function to extract the library members needed by the modules read so far. Every symbol an
+// E instruction references but no module defines is looked up in the libraries in command-line
+// order; the member defining it is extracted and scanned in turn, until nothing new is needed.
+// Extracted members are linked at the position of their library, in member order.
+// Returns the index of a library with a corrupt member, or -1.
+static int extractMembers(const MachineModel& machine, const vector<Library>& libraries, const vector<int>& libraryFiles,
+                          vector<ParsedRange>& parsed) {
+    unordered_set<string_view> defined;    // Names view the modules' arenas, which outlive the extraction
+    vector<const ModuleIR*> pending;    // Modules whose references are still to be scanned, in scan order
+    for (ParsedRange& file : parsed) {
+        for (ModuleIR& module : file.modules) {
+            for (const Definition& definition : module.defList) defined.insert(definition.value);
+            pending.push_back(&module);
+        }
+    }
+
+    vector<map<int, ParsedRange>> extracted(libraries.size());  // Members extracted from each library
+    unordered_set<string_view> searched;    // Undefined symbols already looked up
+    for (size_t next = 0; next < pending.size(); next++) {
+        const ModuleIR& module = *pending[next];
+        Arena reloaded;     // Holds the instructions of a module the first pass only checked
+        InstructionStore instructions = moduleInstructions(machine, module, reloaded);
+        for (size_t i = 0; i < instructions.size(); i++) {
+            int64_t address = instructions.words[i];
+            if (instructions.modes[i] != 'E' || address > machine.largestInstruction()) continue;
+            int64_t operand = address % machine.opcodeRadix;
+            if (operand < 0 || operand >= module.useList.size()) continue;
+            string_view symbol = module.useList[operand];
+            if (defined.count(symbol) || !searched.insert(symbol).second) continue;
+
+            for (int l = 0; l < libraries.size(); l++) {
+                int member = libraries[l].findMember(symbol);
+                if (member == -1) continue;
+                auto inserted = extracted[l].emplace(member, ParsedRange());
+                ParsedRange& range = inserted.first -> second;
+                if (inserted.second) {
+                    if (!libraries[l].extract(member, machine, range) || range.failed) return l;
+                    for (ModuleIR& memberModule : range.modules) {
+                        for (const Definition& definition : memberModule.defList) defined.insert(definition.value);
+                        pending.push_back(&memberModule);
+                    }
                 }
+                break;
             }
-            defList.push_back(currentSymbol);
-            if (flag) defList.back().alreadyDefined = true;
         }
+    }
 
-        // Read the use count and move to the next token
-        int useCount;
-        try {
-            useCount = readInteger(currentToken);
-        } catch(exception E) {
-            Token lastToken = tokenizer.getLastToken();
-            __parseerror(0, lastToken);
+    for (int l = 0; l < libraries.size(); l++) {
+        vector<ModuleIR>& modules = parsed[libraryFiles[l]].modules;
+        for (auto& member : extracted[l]) {
+            for (ModuleIR& memberModule : member.second.modules) modules.push_back(move(memberModule));
         }
+    }
+    return -1;
+}
+
+
+// Function to read the modules of one object input, copying them from the context's input cache
+// when the same bytes were parsed before. The link cache tracks modules as they are parsed, so a
+// link using it always parses, and so does a streaming link, whose modules view their input.
+static bool readObject(LinkContext& context, const Tokenizer& input, ParsedRange& parsed, int threadCount = 1,
+                       bool stopOnTooManyInstructions = false, LinkCache* cache = nullptr) {
+    InputCache* inputCache = cache || context.streaming ? nullptr : context.inputCache;
+    if (inputCache == nullptr) return readModules(context, input, parsed, threadCount, stopOnTooManyInstructions, cache);
+
+    InputKey key = InputCache::key(input.inputBegin(), input.inputEnd() - input.inputBegin(), stopOnTooManyInstructions, context.keepGoing);
+    if (shared_ptr<const ParsedRange> cached = inputCache -> find(key)) {
+        parsed = *cached;
+        return true;
+    }
+    if (!readModules(context, input, parsed, threadCount, stopOnTooManyInstructions)) return false;
+    inputCache -> insert(key, parsed);
+    return true;
+}
 
-        // Error if the number of uses exceeds 16
-        if (useCount > 16) {
-            __parseerror(5, currentToken);
+
+// Function to read the modules of every input. A single object may be parsed in parallel chunks;
+// several objects are parsed concurrently, one input per task. With a link cache the inputs are
+// read one after the other, since the cache matches modules in link order. Libraries are not
+// parsed; their members are extracted on demand once the other inputs are read.
+// Throws an InputError for the first input that is not a valid object or library.
+static void readInputs(LinkContext& context, const vector<LinkInput>& inputs, vector<ParsedRange>& parsed) {
+    int threadCount = context.threadCount;
+    LinkCache* cache = context.cache;
+    vector<Tokenizer> tokenizers(inputs.size());
+    for (int f = 0; f < inputs.size(); f++) tokenizers[f].openBuffer(inputs[f].data, inputs[f].data + inputs[f].size);
+
+    vector<char> valid(inputs.size(), true);
+    vector<int> objectFiles, libraryFiles;
+    vector<Library> libraries;
+    for (int f = 0; f < inputs.size(); f++) {
+        const char* begin = tokenizers[f].inputBegin();
+        size_t inputSize = tokenizers[f].inputEnd() - begin;
+        if (context.stats.enabled) context.stats.bytesRead += inputSize;
+        if (isLibrary(begin, inputSize)) {
+            libraries.emplace_back();
+            valid[f] = libraries.back().open(begin, inputSize);
+            libraryFiles.push_back(f);
+        } else {
+            objectFiles.push_back(f);
         }
-        currentToken = tokenizer.getNextToken();
-        
-        // Skip past the uses, as they're not processed in the first pass
-        for (int i = 0; i < useCount; i++) {
-            try {
-                readSymbol(currentToken);
-                currentToken = tokenizer.getNextToken();
-            } catch(exception E) {
-                Token lastToken = tokenizer.getLastToken();
-                __parseerror(1, lastToken);
-            }
+    }
+
+    if (objectFiles.size() == 1) {
+        int f = objectFiles[0];
+        // A single object stops at the machine size, which ends the link, unless every error is wanted
+        valid[f] = readObject(context, tokenizers[f], parsed[f], threadCount, libraryFiles.empty() && !context.keepGoing, cache);
+    } else if (threadCount <= 1 || cache != nullptr) {
+        for (int f : objectFiles) valid[f] = readObject(context, tokenizers[f], parsed[f], 1, false, cache);
+    } else {
+        ThreadPool pool(min<int>(threadCount, objectFiles.size()));
+        for (int f : objectFiles) {
+            pool.submit([&, f] {
+                TraceScope trace(context.stats, "parse file");
+                valid[f] = readObject(context, tokenizers[f], parsed[f]);
+            });
         }
+        pool.wait();
+    }
 
-        // Read the instruction count for the current module and update the total instruction count
-        int instructionCount;
-        Token instructionToken; // Token to hold the current instruction
-        try {
-            // Update the total instructions with the count for this module
-            instructionToken = currentToken;
-            instructionCount = readInteger(instructionToken);
-            totalInstructions += instructionCount;
-            // Move to the next token
-            currentToken = tokenizer.getNextToken();
-        } catch(const exception& e) {
-            Token lastToken = tokenizer.getLastToken();
-            __parseerror(0, lastToken);
+    // Members only matter to a link whose inputs all parsed
+    bool inputsParsed = true;
+    for (int f : objectFiles) inputsParsed = inputsParsed && valid[f] && !parsed[f].failed;
+    if (inputsParsed && !libraries.empty()) {
+        bool librariesValid = true;
+        for (int l = 0; l < libraries.size(); l++) librariesValid = librariesValid && valid[libraryFiles[l]];
+        if (librariesValid) {
+            int corrupt = extractMembers(context.machine, libraries, libraryFiles, parsed);
+            if (corrupt != -1) valid[libraryFiles[corrupt]] = false;
+        }
+    }
+
+    for (int f = 0; f < inputs.size(); f++) {
+        if (!valid[f]) {
+            InputError error;
+            error.fileName = inputs[f].name;
+            throw error;
+        }
+        parsed[f].error.fileIndex = f;
+        for (ModuleIR& module : parsed[f].modules) module.fileIndex = f;
+    }
+}
+
+
+// Function to throw every parse error of the inputs for --keep-going, ordered by position: the
+// errors each input's parse recovered from and the first module that overflows the machine.
+// The first error thrown is the one a link without --keep-going stops at. Returns if there are none.
+static void throwParseErrors(const LinkContext& context, const vector<ParsedRange>& parsed) {
+    ParseErrorList list;
+    int64_t totalInstructions = 0;
+    bool overflowed = false;
+    for (int f = 0; f < parsed.size(); f++) {
+        for (const ModuleIR& module : parsed[f].modules) {
+            totalInstructions += module.instructionCount;
+            if (totalInstructions > context.machine.memorySize && !overflowed) {
+                ParseError error;
+                error.errcode = 6;
+                error.lineNumber = module.instructionCountLine;
+                error.lineOffset = module.instructionCountOffset;
+                error.fileIndex = f;
+                list.errors.push_back(error);
+                overflowed = true;
+            }
+        }
+        if (parsed[f].failed) list.errors.push_back(parsed[f].error);
+        for (ParseError error : parsed[f].laterErrors) {
+            error.fileIndex = f;
+            list.errors.push_back(error);
         }
+    }
+    if (list.errors.empty()) return;
+
+    stable_sort(list.errors.begin(), list.errors.end(), [](const ParseError& a, const ParseError& b) {
+        if (a.fileIndex != b.fileIndex) return a.fileIndex < b.fileIndex;
+        if (a.lineNumber != b.lineNumber) return a.lineNumber < b.lineNumber;
+        return a.lineOffset < b.lineOffset;
+    });
+    throw list;
+}
+
+
+// Definitions below which resolving the symbols is not worth starting threads for
+static const size_t parallelSymbolDefinitions = 1 << 12;
+
 
-        // Error if the total number of instructions exceeds 512
-        if (totalInstructions > 512) {
-            __parseerror(6, instructionToken);
+// Function to build the symbol table from the definitions of the link, in module order, and flag
+// every definition that an earlier one of the same name overrides. With concurrentSymbols set the
+// definitions are added to a ConcurrentSymbolTable in chunks at the same time, ranked by their
+// position, so the table and the flags come out as in the serial run. The serial run is the
+// default, as it has measured faster (bench --symbols).
+static void resolveSymbols(LinkContext& context, SymbolTable& symbols, vector<Symbol>& definitions) {
+    if (!context.concurrentSymbols || context.threadCount <= 1 || definitions.size() < parallelSymbolDefinitions) {
+        // Add the symbol unless it is already defined, in which case the existing one is flagged
+        for (Symbol& definition : definitions) {
+            if (!symbols.insert(definition)) definition.alreadyDefined = true;
         }
+        return;
+    }
+
+    ConcurrentSymbolTable shared;
+    LinkStats* stats = context.stats.enabled ? &context.stats : nullptr;
+    shared.countProbes(stats);
+    vector<int64_t> places(definitions.size());     // Where the name of each definition is held
+    size_t chunkSize = (definitions.size() + context.threadCount * 4 - 1) / (context.threadCount * 4);
+    ThreadPool pool(context.threadCount);
+    for (size_t first = 0; first < definitions.size(); first += chunkSize) {
+        pool.submit([&, first] {
+            size_t last = min(definitions.size(), first + chunkSize);
+            for (size_t i = first; i < last; i++) places[i] = shared.insert(definitions[i], i);
+        });
+    }
+    pool.wait();
+    for (size_t i = 0; i < definitions.size(); i++) definitions[i].alreadyDefined = shared.rankAt(places[i]) != i;
+    symbols = shared.ordered(definitions.size(), stats);
+}
 
-        // Skip past the instructions, as they're not processed in the first pass
-        for (int i = 0; i < instructionCount; i++) {
-            try {
-                // Read and discard each instruction type
-                readMARIE(currentToken);
-                currentToken = tokenizer.getNextToken();
-            } catch(const exception& e) {
-                Token lastToken = tokenizer.getLastToken();
-                __parseerror(2, lastToken);
+
+// Function to drop the modules no root module reaches (--gc-modules). A module reaches the modules
+// defining the symbols its E instructions use and the modules its M instructions name. The kept
+// modules are placed again one after another, and the symbol table is built again from their
+// definitions alone, so a definition in a dropped module neither wins nor clashes. Roots that name
+// no module are ignored.
+static void collectModules(LinkContext& context, const vector<ModuleIR>& modules, SymbolTable& symbols, vector<Symbol>& definitions) {
+    vector<Module>& module_base = context.moduleBases;
+    const int64_t radix = context.machine.opcodeRadix;
+    const int64_t largestInstruction = context.machine.largestInstruction();
+    int moduleCount = modules.size();
+
+    vector<char> reached(moduleCount, false);
+    vector<int> pending;
+    for (int root : context.rootModules) {
+        if (root >= 0 && root < moduleCount && !reached[root]) {
+            reached[root] = true;
+            pending.push_back(root);
+        }
+    }
+    while (!pending.empty()) {
+        const ModuleIR& module = modules[pending.back()];
+        pending.pop_back();
+        Arena arena;    // Instructions read again when the first pass only checked them
+        InstructionStore instructions = module.instructionsStored() ? module.instructions : moduleInstructions(context.machine, module, arena);
+        int useCount = module.useList.size();
+        for (int i = 0; i < instructions.size(); i++) {
+            // An illegal opcode is not relocated, so its operand names nothing
+            int64_t word = instructions.words[i];
+            if (word > largestInstruction) continue;
+            int64_t operand = word % radix;
+            int target = -1;
+            if (instructions.modes[i] == 'M' && operand >= 0 && operand < moduleCount) {
+                target = operand;
+            } else if (instructions.modes[i] == 'E' && operand >= 0 && operand < useCount) {
+                int index = symbols.find(module.useList[operand]);
+                if (index != -1) target = symbols[index].moduleNumber - 1;
             }
-            
-            try {
-                // Read and discard each instruction operand
-                readInteger(currentToken);
-                currentToken = tokenizer.getNextToken();
-            } catch(const exception& e) {
-                Token lastToken = tokenizer.getLastToken();
-                __parseerror(0, lastToken);
+            if (target != -1 && !reached[target]) {
+                reached[target] = true;
+                pending.push_back(target);
             }
         }
+    }
 
-        Module currentModule;
-        currentModule.moduleBaseAddr = baseAddress;
-        currentModule.moduleSize = instructionCount;
-        module_base.push_back(currentModule);
+    int64_t baseAddress = 0;
+    for (int i = 0; i < moduleCount; i++) {
+        module_base[i].removed = !reached[i];
+        module_base[i].moduleBaseAddr = baseAddress;
+        if (reached[i]) baseAddress += module_base[i].moduleSize;
+    }
 
-        // Update the base address for the next module
-        baseAddress += instructionCount;
+    SymbolTable keptSymbols;
+    if (context.stats.enabled) keptSymbols.countProbes(&context.stats);
+    vector<Symbol> keptDefinitions;
+    for (Symbol definition : definitions) {
+        if (module_base[definition.moduleNumber - 1].removed) continue;
+        definition.Addr = definition.relativeAddr + module_base[definition.moduleNumber - 1].moduleBaseAddr;
+        definition.alreadyDefined = false;
+        if (!keptSymbols.insert(definition)) definition.alreadyDefined = true;
+        keptDefinitions.push_back(definition);
     }
+    symbols = move(keptSymbols);
+    definitions = move(keptDefinitions);
+}
 
-    // Check if the symbol is already defined, set the flag if so
-    for (int i = 0; i < defList.size(); i++) {
-        int index = -1;
-        for (int j = 0; j < symbols.size(); j++) {
-            if (defList[i].value.compare(symbols[j].value) == 0) {
-                index = j;
-                break;
+
+// Function representing the first pass of the two-pass linker, processes definitions and uses
+// and records every module in the intermediate representation consumed by the second pass.
+// The modules of all input files are linked as one sequence, in command-line order. Parsing may
+// run in parallel; base addresses are then assigned in module order, and the symbol table is
+// resolved by definition order even when built on several threads, so diagnostics come out
+// exactly as in a serial run.
+SymbolTable firstPass(LinkContext& context, const vector<LinkInput>& inputs, vector<ModuleIR>& modules, OutputBuffer& out) {
+    vector<ParsedRange> parsed(inputs.size());
+    readInputs(context, inputs, parsed);
+    if (context.keepGoing) throwParseErrors(context, parsed);
+
+    vector<Module>& module_base = context.moduleBases;
+    int64_t totalInstructions = 0;
+    SymbolTable symbols;        // Table of the distinct symbols found in the first pass
+    if (context.stats.enabled) symbols.countProbes(&context.stats);
+    int64_t baseAddress = 0;    // Starting address for the current module
+    vector<Symbol> definitions; // Every definition with its address, in module order
+
+    size_t moduleCount = modules.size();
+    for (ParsedRange& file : parsed) moduleCount += file.modules.size();
+    modules.reserve(moduleCount);
+    module_base.reserve(moduleCount);
+
+    for (ParsedRange& file : parsed) {
+        for (int i = 0; i < file.modules.size(); i++) {
+            modules.push_back(move(file.modules[i]));
+            ModuleIR& module = modules.back();
+            int moduleNumber = modules.size();
+
+            // Error if the total number of instructions exceeds the machine size (512)
+            totalInstructions += module.instructionCount;
+            if (totalInstructions > context.machine.memorySize) {
+                Token instructionToken;
+                instructionToken.setToken(module.instructionCountLine, module.instructionCountOffset, "");
+                __parseerror(6, instructionToken, module.fileIndex);
+            }
+            // A parse error in the instructions of the last module comes after the instruction count check
+            if (file.failed && !file.failedInHeader && i == file.modules.size() - 1) throw file.error;
+
+            for (const Definition& parsedDefinition : module.defList) {
+                Symbol definition;
+                definition.value = parsedDefinition.value;
+                definition.relativeAddr = parsedDefinition.relativeAddr;
+                definition.Addr = definition.relativeAddr + baseAddress;
+                definition.moduleNumber = moduleNumber;
+                definitions.push_back(definition);
             }
+
+            Module currentModule;
+            currentModule.moduleBaseAddr = baseAddress;
+            currentModule.moduleSize = module.instructionCount;
+            module_base.push_back(currentModule);
+
+            // Update the base address for the next module
+            baseAddress += module.instructionCount;
         }
+        if (file.failed) throw file.error;
+    }
+
+    resolveSymbols(context, symbols, definitions);
+    if (!context.rootModules.empty()) collectModules(context, modules, symbols, definitions);
+
+    OutputBuffer line(-1, 256);     // Warning being formatted
+    vector<string>* diagnostics = context.record ? &context.record -> diagnostics : nullptr;
+
+    // Check if the symbol is already defined, set the flag if so
+    for (Symbol& definition : definitions) {
+        int index = symbols.find(definition.value);
 
         // Check if the symbol's relative address exceeds the size of its module.
-        if (defList[i].relativeAddr > module_base[defList[i].moduleNumber - 1].moduleSize - 1 && !defList[i].alreadyDefined) { 
+        if (definition.relativeAddr > module_base[definition.moduleNumber - 1].moduleSize - 1 && !definition.alreadyDefined) { 
             if (symbols[index].moduleNumber > 1) {
                 symbols[index].Addr -= module_base[symbols[index].moduleNumber - 1].moduleBaseAddr; 
-                defList[i].Addr -= module_base[defList[i].moduleNumber - 1].moduleBaseAddr;
+                definition.Addr -= module_base[definition.moduleNumber - 1].moduleBaseAddr;
             }
             // Print a warning for symbols with invalid relative addresses, assuming a zero relative address.
-            cout << "Warning: Module " << defList[i].moduleNumber - 1 << ": " 
-                 << defList[i].value << "=" << defList[i].Addr 
-                 << " valid=[0.." << module_base[defList[i].moduleNumber - 1].moduleSize  - 1 << "] assume zero relative\n";
+            line.append("Warning: Module ");
+            line.appendNumber(definition.moduleNumber - 1);
+            line.append(": ");
+            line.append(definition.value);
+            line.append('=');
+            line.appendNumber(definition.Addr);
+            line.append(" valid=[0..");
+            line.appendNumber(module_base[definition.moduleNumber - 1].moduleSize - 1);
+            line.append("] assume zero relative");
+            listDiagnostic(line, out, diagnostics);
 
             // Reset the symbol's address to the base address of its module.
             symbols[index].Addr = module_base[symbols[index].moduleNumber - 1].moduleBaseAddr;
-            defList[i].Addr = module_base[defList[i].moduleNumber - 1].moduleBaseAddr;
+            definition.Addr = module_base[definition.moduleNumber - 1].moduleBaseAddr;
         }
 
         // Print a warning if the symbol is redefined.
-        if (defList[i].alreadyDefined) cout << "Warning: Module " << defList[i].moduleNumber - 1 << ": " << defList[i].value << " redefinition ignored\n";
+        if (definition.alreadyDefined) {
+            line.append("Warning: Module ");
+            line.appendNumber(definition.moduleNumber - 1);
+            line.append(": ");
+            line.append(definition.value);
+            line.append(" redefinition ignored");
+            listDiagnostic(line, out, diagnostics);
+        }
     }
 
-    // Return the vector of symbols found in the first pass
+    // Return the table of symbols found in the first pass
     return symbols;
 }
 
 
-// Function representing the second pass of the two-pass linker, generates the memory map
-vector<Symbol> secondPass(string fileName, vector<Symbol> symbolTable) {
-    // Create a tokenizer object
-    Tokenizer tokenizer;
-    // Exit if file cannot be opened
-    if (!tokenizer.openFile(fileName)) {
-        cout << "Unable to open file " << fileName << endl;
-        exit(0); 
+// Class holding the buffers relocateModule reuses from one module to the next, so relocating
+// allocates nothing once they have grown to the largest module and use list
+class RelocationScratch {
+public:
+    vector<int64_t> finalAddresses;     // Relocated word of each instruction
+    vector<uint8_t> errors;             // Relocation outcome of each instruction
+    vector<int> byMode;                 // Instructions grouped by addressing mode, in the order of AddressModeSlots
+    vector<char> externalReferenced;    // Whether an E instruction used each use list entry
+    vector<int> externalIndices;        // Symbol table index of each use list entry
+    vector<int64_t> externalAddresses;  // Address of each use list entry, 0 if it is not defined
+    OutputBuffer line{-1, 256};         // Memory map line or warning being formatted, when it is a diagnostic
+};
+
+
+// Class holding the group of each addressing mode in RelocationScratch::byMode, -1 for bytes that
+// are not an addressing mode. A table rather than a switch, so grouping costs no call per instruction.
+class AddressModeSlots {
+public:
+    int8_t slot[256];
+
+    constexpr AddressModeSlots() : slot() {
+        for (int8_t& s : slot) s = -1;
+        slot['A'] = 0;
+        slot['I'] = 1;
+        slot['R'] = 2;
+        slot['M'] = 3;
+        slot['E'] = 4;
     }
+};
 
-    string line;
-    // Vector to store symbols found in the second pass
-    vector<Symbol> symbols;
+static constexpr AddressModeSlots addressModeSlots;
 
-    int baseAddress = 0;    // Starting address for the current module
-    int moduleNumber = 0;   // Counter for the current module number
-    int memoryMapIndex = 0;      // Counter for the memory map entries
 
-    Token currentToken = tokenizer.getNextToken();  // Get the first token
-    // Continue until there are no more tokens   
-    while (!currentToken.tokenContents.empty()) {
-        moduleNumber++;
-        // Store the number of definitions in the current module 
-        int definitionCount;
+// Function to relocate one module, writing its memory map entries and warnings to out.
+// Only reads shared state: the symbols it uses are collected in usedSymbols instead of being
+// marked in the table, so several modules can be relocated at the same time.
+// The instructions are relocated in sweeps: a first one rejects illegal opcodes and groups the
+// rest by addressing mode, then one kernel per mode computes the final words and error codes of
+// its group, and a last sweep prints the memory map in instruction order, or copies it into the
+// context's memory image when there is one. The kernels are short straight loops over the
+// packed words with no dispatch on the mode. Error codes are those of the image's diagnostics.
+static void relocateModule(const LinkContext& context, const ModuleIR& module, int moduleNumber, int64_t baseAddress,
+                           int64_t memoryMapIndex, const SymbolTable& symbolTable, OutputBuffer& out, vector<int>& usedSymbols,
+                           RelocationScratch& scratch) {
+    const MachineModel& machine = context.machine;
+    const vector<Module>& module_base = context.moduleBases;
+    const int64_t radix = machine.opcodeRadix;
+    const int64_t largestInstruction = machine.largestInstruction();
 
-        try {
-            // Read the definition count
-            definitionCount = readInteger(currentToken);
-            currentToken = tokenizer.getNextToken();
-        } catch(exception E) {
-             Token lastToken = tokenizer.getLastToken();
-            __parseerror(0, lastToken);
+    const char* modes = module.instructions.modes.begin();
+    const int64_t* words = module.instructions.words.begin();
+    int count = module.instructions.size();
+    scratch.finalAddresses.resize(count);
+    scratch.errors.resize(count);
+    int64_t* finalAddresses = scratch.finalAddresses.data();
+    uint8_t* errors = scratch.errors.data();
+
+    // External symbols used in the module
+    const ArenaList<string_view>& externalSymbols = module.useList;
+    int useCount = externalSymbols.size();
+    vector<char>& externalReferenced = scratch.externalReferenced;
+    externalReferenced.assign(useCount, false);
+
+    // Resolve the use list once, E instructions then gather their symbol's address from a table
+    vector<int>& externalIndices = scratch.externalIndices;
+    vector<int64_t>& externalAddresses = scratch.externalAddresses;
+    externalIndices.resize(useCount);
+    externalAddresses.resize(useCount);
+    for (int i = 0; i < useCount; i++) {
+        externalIndices[i] = symbolTable.find(externalSymbols[i]);
+        externalAddresses[i] = externalIndices[i] == -1 ? 0 : symbolTable[externalIndices[i]].Addr;
+    }
+
+    // Reject illegal opcodes, whatever their mode, and group the other instructions by mode. The
+    // groups are laid out one after another in byMode, group g between groupStart[g] and groupStart[g + 1].
+    int groupStart[6] = {0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < count; i++) {
+        finalAddresses[i] = 0;
+        errors[i] = relocationValid;
+        if (words[i] > largestInstruction) {
+            finalAddresses[i] = largestInstruction;
+            errors[i] = illegalOpcode;
+            continue;
         }
+        int slot = addressModeSlots.slot[(unsigned char) modes[i]];
+        if (slot != -1) groupStart[slot + 1]++;
+    }
+    for (int g = 1; g < 6; g++) groupStart[g] += groupStart[g - 1];
+    scratch.byMode.resize(count);
+    int* byMode = scratch.byMode.data();
+    int groupEnd[5] = {groupStart[0], groupStart[1], groupStart[2], groupStart[3], groupStart[4]};
+    for (int i = 0; i < count; i++) {
+        if (errors[i] == relocationValid) {
+            int slot = addressModeSlots.slot[(unsigned char) modes[i]];
+            if (slot != -1) byMode[groupEnd[slot]++] = i;
+        }
+    }
 
-        // Skip past the definitions, as they're not processed in the second pass
-        for (int i = 0; i < 2 * definitionCount; i++) currentToken = tokenizer.getNextToken();
+    // Every kernel writes opcode * radix as word - operand, the two agree for any sign of word
 
-        
-        // Read the use count and move to the next token, handling any exceptions
-        int useCount;
-        try {
-            // Read the use count
-            useCount = readInteger(currentToken);
-            currentToken = tokenizer.getNextToken();
-        } catch(const exception& e) {
-            Token lastToken = tokenizer.getLastToken();
-            __parseerror(0, lastToken);
-        }
-
-        // Process each use symbol and mark corresponding symbols in the symbol table as used
-        vector<string> externalSymbols;     // Vector to store external symbols used in the module
-        vector<int> externalReferences;     // Vector to store external symbol references
-        for(int i = 0; i < useCount; i++) {
-            try {
-                // Read the external symbol and add it to the vector
-                string currentSymbol = readSymbol(currentToken);
-                externalSymbols.push_back(currentSymbol);
-                currentToken = tokenizer.getNextToken();
-            }
-            catch(exception E) {
-                Token lastToken = tokenizer.getLastToken();
-                __parseerror(1, lastToken);
-            }
+    // A: absolute operands must lie inside the machine, zero is used otherwise
+    for (const int* group = byMode + groupStart[0]; group < byMode + groupStart[1]; group++) {
+        int i = *group;
+        int64_t operand = words[i] % radix;
+        bool valid = operand < machine.memorySize;
+        finalAddresses[i] = valid ? words[i] : words[i] - operand;
+        errors[i] = valid ? relocationValid : absoluteTooLarge;
+    }
+
+    // I: immediate operands at or above the limit are clamped to the largest operand
+    for (const int* group = byMode + groupStart[1]; group < byMode + groupStart[2]; group++) {
+        int i = *group;
+        int64_t operand = words[i] % radix;
+        bool valid = operand < machine.immediateLimit;
+        finalAddresses[i] = valid ? words[i] : words[i] - operand + machine.largestOperand();
+        errors[i] = valid ? relocationValid : illegalImmediate;
+    }
+
+    // R: relative operands are added to the module base, relative zero is used past the module
+    for (const int* group = byMode + groupStart[2]; group < byMode + groupStart[3]; group++) {
+        int i = *group;
+        int64_t operand = words[i] % radix;
+        bool valid = operand < module.instructionCount;
+        finalAddresses[i] = baseAddress + (valid ? words[i] : words[i] - operand);
+        errors[i] = valid ? relocationValid : relativeTooLarge;
+    }
+
+    // M: module operands are replaced by the base of the module they name, module 0 otherwise
+    for (const int* group = byMode + groupStart[3]; group < byMode + groupStart[4]; group++) {
+        int i = *group;
+        int64_t operand = words[i] % radix;
+        bool valid = operand >= 0 && operand < (int64_t) module_base.size();
+        finalAddresses[i] = words[i] - operand + (valid ? module_base[operand].moduleBaseAddr : 0);
+        errors[i] = valid ? relocationValid : illegalModuleOperand;
+    }
+
+    // E: external operands index the use list and are replaced by the address of the symbol
+    for (const int* group = byMode + groupStart[4]; group < byMode + groupStart[5]; group++) {
+        int i = *group;
+        int64_t operand = words[i] % radix;
+        if (operand >= 0 && operand < useCount) {
+            externalReferenced[operand] = true;
+            finalAddresses[i] = words[i] - operand + externalAddresses[operand];
+            errors[i] = externalIndices[operand] != -1 ? relocationValid : undefinedExternal;
+        } else {
+            // Handle external operand exceeding the length of the uselist, treated as relative zero
+            finalAddresses[i] = words[i] - operand + baseAddress;
+            errors[i] = externalTooLarge;
         }
+    }
 
-        // Read the instruction count for the current module and update the instruction indexing
-        int instructionCount;
-        Token instructionToken; // Token to hold the current instruction
-        try {
-            // Read the instruction count
-            instructionToken = currentToken;
-            instructionCount = readInteger(instructionToken);
-            currentToken = tokenizer.getNextToken();
-        } catch(const exception& e) {
-            Token lastToken = tokenizer.getLastToken();
-            __parseerror(0, lastToken);
+    // Record the symbols the module used, once per use list entry
+    for (int i = 0; i < useCount; i++) {
+        if (externalReferenced[i] && externalIndices[i] != -1) usedSymbols.push_back(externalIndices[i]);
+    }
+
+    // Print the memory map entries in instruction order, with the error of each instruction.
+    // Modules own disjoint parts of an image, so modules relocated at the same time can fill it.
+    MemoryImage* image = context.image;
+    if (image) {
+        copy(finalAddresses, finalAddresses + count, image -> words.begin() + memoryMapIndex);
+        copy(errors, errors + count, image -> errors.begin() + memoryMapIndex);
+    }
+    if (image && image -> recordFixups) {
+        // Fixup kind of each addressing mode slot (A, I, R, M, E)
+        static const uint8_t slotFixups[5] = {fixupNone, fixupNone, fixupRelative, fixupModule, fixupExternal};
+        for (int i = 0; i < count; i++) {
+            int slot = addressModeSlots.slot[(unsigned char) modes[i]];
+            bool addressed = slot != -1 && errors[i] != illegalOpcode && errors[i] != illegalModuleOperand && errors[i] != undefinedExternal;
+            image -> fixups[memoryMapIndex + i] = addressed ? slotFixups[slot] : fixupNone;
+        }
+    }
+    // Lines with an error are diagnostics; with a record they are kept, and every word with them
+    LinkRecord* record = context.record;
+    vector<string>* diagnostics = record ? &record -> moduleDiagnostics[moduleNumber - 1] : nullptr;
+    OutputBuffer& line = scratch.line;
+    for (int i = 0; i < count && (image == nullptr || record); i++) {
+        if (record) record -> memoryMap[memoryMapIndex + i].value = finalAddresses[i];
+        if (errors[i] == relocationValid) {
+            if (image) continue;
+            out.appendEntry(memoryMapIndex + i, finalAddresses[i], machine.indexWidth, machine.addressWidth);
+            out.append('\n');
+            continue;
+        }
+        line.appendEntry(memoryMapIndex + i, finalAddresses[i], machine.indexWidth, machine.addressWidth);
+        line.append(' ');
+        size_t errorStart = line.size();
+        switch (errors[i]) {
+            case illegalOpcode:
+                line.append("Error: Illegal opcode; treated as ");
+                line.appendNumber(largestInstruction);
+                break;
+            case illegalModuleOperand:
+                line.append("Error: Illegal module operand ; treated as module=0");
+                break;
+            case absoluteTooLarge:
+                line.append("Error: Absolute address exceeds machine size; zero used");
+                break;
+            case relativeTooLarge:
+                line.append("Error: Relative address exceeds module size; relative zero used");
+                break;
+            case illegalImmediate:
+                line.append("Error: Illegal immediate operand; treated as ");
+                line.appendNumber(machine.largestOperand());
+                break;
+            case undefinedExternal:
+                line.append("Error: ");
+                line.append(externalSymbols[words[i] % radix]);
+                line.append(" is not defined; zero used");
+                break;
+            case externalTooLarge:
+                line.append("Error: External operand exceeds length of uselist; treated as relative=0");
+                break;
+        }
+        if (record) record -> memoryMap[memoryMapIndex + i].error = line.view().substr(errorStart);
+        if (image) line.clear();
+        else listDiagnostic(line, out, diagnostics);
+    }
+
+    // Warn about unused external symbols in the module's uselist
+    for (int i = 0; i < useCount; i++) {
+        // Print a warning message
+        if (!externalReferenced[i]) {
+            line.append("Warning: Module ");
+            line.appendNumber(moduleNumber - 1);
+            line.append(": uselist[");
+            line.appendNumber(i);
+            line.append("]=");
+            line.append(externalSymbols[i]);
+            line.append(" was not used");
+            listDiagnostic(line, out, diagnostics);
         }
+    }
+}
+
 
-        // Error if the instruction count for the module exceeds 512
-        if (instructionCount > 512) {
-            __parseerror(6, instructionToken);
+// Function to hash everything the relocation of a cached module depends on besides its own text:
+// its number, which its warnings name, where it is placed, the bases of the modules its M
+// instructions name and the symbols it uses
+static uint64_t relocationKey(const LinkContext& context, const CacheEntry& entry, const ModuleIR& module, int moduleIndex,
+                              int64_t baseAddress, int64_t memoryMapIndex, const SymbolTable& symbolTable) {
+    const vector<Module>& module_base = context.moduleBases;
+    vector<int64_t> inputs = {moduleIndex, baseAddress, memoryMapIndex};
+    for (int64_t operand : entry.moduleOperands) {
+        bool valid = operand >= 0 && operand < module_base.size();
+        inputs.push_back(valid ? module_base[operand].moduleBaseAddr : INT64_MIN);
+    }
+    for (string_view use : module.useList) {
+        int index = symbolTable.find(use);
+        inputs.push_back(index == -1 ? INT64_MIN : symbolTable[index].Addr);
+    }
+    return hashBytes((const char*) inputs.data(), inputs.size() * sizeof(int64_t));
+}
+
+
+// Function to relocate a module through the link cache. The text of its previous relocation is
+// reused when the relocation key matches; otherwise the module is relocated and the text kept.
+// The cache only keeps text, so a module relocated into a memory image or a record is always relocated.
+static void relocateModuleCached(const LinkContext& context, const ModuleIR& module, int moduleIndex, int64_t baseAddress,
+                                 int64_t memoryMapIndex, const SymbolTable& symbolTable, OutputBuffer& out, vector<int>& usedSymbols,
+                                 RelocationScratch& scratch, LinkCache* cache) {
+    if (context.moduleBases[moduleIndex].removed) return;
+    if (cache == nullptr || context.image || context.record) {
+        relocateModule(context, module, moduleIndex + 1, baseAddress, memoryMapIndex, symbolTable, out, usedSymbols, scratch);
+        return;
+    }
+
+    CacheEntry& entry = cache -> entry(moduleIndex);
+    uint64_t key = relocationKey(context, entry, module, moduleIndex, baseAddress, memoryMapIndex, symbolTable);
+    if (entry.relocated && entry.relocationKey == key) {
+        out.append(entry.output);
+        // A referenced use marks its symbol as used whenever the symbol is defined
+        for (int use : entry.referencedUses) {
+            int index = symbolTable.find(module.useList[use]);
+            if (index != -1) usedSymbols.push_back(index);
         }
+        cache -> relocationHits++;
+        return;
+    }
+
+    OutputBuffer piece(-1, 1 << 12);
+    relocateModule(context, module, moduleIndex + 1, baseAddress, memoryMapIndex, symbolTable, piece, usedSymbols, scratch);
+    entry.output.assign(piece.view());
+    entry.relocated = true;
+    entry.relocationKey = key;
+    out.append(piece.view());
+}
 
-        // Initialize variables to handle errors and error messages
-        bool errorExists = false;
-        string errorString = "";
 
-        // Process each instruction in the current module
-        for(int i = 0; i < instructionCount; i++) {   
-            string addressMode;     // Variable to store the address mode of the instruction
-            int address;            // Variable to store the address part of the instruction
+// Function to relocate the first moduleCount modules on a pool of threadCount workers.
+// Modules are grouped in batches, several per thread to balance uneven module sizes. Each batch is
+// formatted into its own buffer and handed to an OutputSink, which writes it to out as soon as
+// every batch before it is done.
+static void relocateModulesParallel(LinkContext& context, const vector<ModuleIR>& modules, int moduleCount, const vector<int64_t>& mapStart,
+                                    SymbolTable& symbolTable, OutputBuffer& out, int threadCount, LinkCache* cache) {
+    int batchSize = max(1, moduleCount / (threadCount * 8));
+    int batchCount = (moduleCount + batchSize - 1) / batchSize;
+    vector<vector<int>> usedSymbols(batchCount);
+    OutputSink sink(out);
 
-            // Read the address mode and move to the next token
-            try {
-                addressMode = readMARIE(currentToken); 
-                currentToken = tokenizer.getNextToken();
+    ThreadPool pool(threadCount);
+    for (int batch = 0; batch < batchCount; batch++) {
+        pool.submit([&, batch] {
+            TraceScope trace(context.stats, "relocate batch");
+            OutputBuffer piece(-1, 1 << 16);
+            RelocationScratch scratch;
+            int last = min(moduleCount, (batch + 1) * batchSize);
+            for (int i = batch * batchSize; i < last; i++) {
+                relocateModuleCached(context, modules[i], i, context.moduleBases[i].moduleBaseAddr, mapStart[i], symbolTable, piece,
+                                     usedSymbols[batch], scratch, cache);
             }
-            catch(const exception& e) {
-                Token lastToken = tokenizer.getLastToken();
-                __parseerror(2, lastToken);
+            sink.submit(batch, piece.release());
+        });
+    }
+    pool.wait();
+
+    for (vector<int>& batch : usedSymbols) {
+        for (int index : batch) symbolTable[index].used = true;
+    }
+}
+
+
+// Instructions per batch of a streaming link, and batches each queue between two of its stages holds
+static const int64_t streamBatchInstructions = 1 << 14;
+static const size_t streamQueueBatches = 4;
+
+
+// Class holding a batch of consecutive modules on its way through the streaming pipeline
+class StreamBatch {
+public:
+    int first = 0;                  // The batch holds modules [first, last) of the link
+    int last = 0;
+    vector<ModuleIR> modules;       // Copies of the modules, with their instructions read again if need be
+    Arena arena;                    // Instructions read again for the batch
+    OutputBuffer listing;           // Memory map lines and warnings of the batch
+    vector<int> usedSymbols;
+
+    StreamBatch() : listing(-1, 1 << 16) {}
+};
+
+
+// Function to relocate the first moduleCount modules of a streaming link as a pipeline of three
+// stages joined by bounded queues of module batches: a reader thread reads the instructions of
+// each batch again from the input, a relocation thread formats the batch's memory map, and the
+// calling thread writes the batches to out in module order and marks the symbols they used
+// (relocation never reads that mark). Reading the input, relocating and writing the output
+// overlap, and since a stage stops when the queue it feeds is full, only a few batches of
+// instructions are in memory at any time, however large the input.
+static void relocateModulesStreaming(LinkContext& context, const vector<ModuleIR>& modules, int moduleCount, const vector<int64_t>& mapStart,
+                                     SymbolTable& symbolTable, OutputBuffer& out, LinkCache* cache) {
+    SpscQueue<unique_ptr<StreamBatch>> readBatches(streamQueueBatches);
+    SpscQueue<unique_ptr<StreamBatch>> relocatedBatches(streamQueueBatches);
+
+    // An empty batch pointer tells the next stage that no batches follow
+    thread reader([&] {
+        int next = 0;
+        while (next < moduleCount) {
+            TraceScope trace(context.stats, "stream read batch");
+            unique_ptr<StreamBatch> batch = make_unique<StreamBatch>();
+            batch -> first = next;
+            int64_t instructionTotal = 0;
+            while (next < moduleCount && instructionTotal < streamBatchInstructions) {
+                const ModuleIR& module = modules[next++];
+                batch -> modules.push_back(module);
+                if (context.moduleBases[next - 1].removed) continue;
+                batch -> modules.back().instructions = moduleInstructions(context.machine, module, batch -> arena);
+                instructionTotal += batch -> modules.back().instructions.size();
             }
-            
-            // Read the address part of the instruction and move to the next token, handling any exceptions
-            try {
-                address = readInteger(currentToken);
-                currentToken = tokenizer.getNextToken();
-            } catch(const exception& e) {
-                Token lastToken = tokenizer.getLastToken();
-                __parseerror(0, lastToken);
+            batch -> last = next;
+            readBatches.push(move(batch));
+        }
+        readBatches.push(nullptr);
+    });
+
+    thread relocator([&] {
+        RelocationScratch scratch;
+        while (unique_ptr<StreamBatch> batch = readBatches.pop()) {
+            TraceScope trace(context.stats, "stream relocate batch");
+            for (int i = batch -> first; i < batch -> last; i++) {
+                relocateModuleCached(context, batch -> modules[i - batch -> first], i, context.moduleBases[i].moduleBaseAddr, mapStart[i],
+                                     symbolTable, batch -> listing, batch -> usedSymbols, scratch, cache);
             }
-            // Flag to indicate if there's an error with the opcode
-            bool opcodeErrorExists = false;
-            
-            // Extract the opcode and operand from the address
-            int opcode = address / 1000;
-            int operand = address % 1000;
-            int finalAddress = 0;   // Variable to store the final computed address
-
-            // Check for illegal opcode error
-            if (address > 9999) {
-                // Set the opcode error flag and message
-                opcodeErrorExists = true;
-                // Set the final address to 9999 (error condition)
-                finalAddress = 9999;
-                errorString = "Error: Illegal opcode; treated as 9999";
-                operand = 999;
-                opcode = 9;
-
-            } else if (addressMode[0] == 'M') {
-                // Handle 'M' address mode (module)
-                // Extract the requested module number from the operand
-                int requestedModule = operand % 1000;
-                // Check if the requested module is out of range
-                if (requestedModule > module_base.size() - 1) {
-                    errorString = "Error: Illegal module operand ; treated as module=0";
-                    // Set the final address (with module set to 0)
-                    finalAddress = opcode * 1000;
-                    errorExists = true;
-                } else {
-                    // Compute the final address using the opcode and the base address of the requested module
-                    finalAddress = opcode * 1000 + module_base[requestedModule].moduleBaseAddr;
-                }
+            relocatedBatches.push(move(batch));
+        }
+        relocatedBatches.push(nullptr);
+    });
 
-            } else if (addressMode[0] == 'A') {
-                // Handle 'A' address mode (absolute)
-                // Check if the operand is within the machine size limit
-                if (operand < 512) {
-                    // Use the address as-is
-                    finalAddress = address;
-                } else {
-                    errorString = "Error: Absolute address exceeds machine size; zero used";
-                    // Set the final address (with operand set to 0)
-                    finalAddress = opcode * 1000;
-                    errorExists = true;
-                }
-                
-            } else if (addressMode[0] == 'R') {
-                // Handle 'R' address mode (relative)
-                // Check if the operand is within the current module's instruction count
-                if (operand < instructionCount) {
-                    // Compute the final address using the base address, opcode, and operand
-                    finalAddress = baseAddress + opcode * 1000 + operand;
-                } else {
-                    // Set the final address (with operand set to 0)
-                    finalAddress = baseAddress + opcode * 1000;
-                    errorString = "Error: Relative address exceeds module size; relative zero used";
-                    errorExists = true;
-                }
+    while (unique_ptr<StreamBatch> batch = relocatedBatches.pop()) {
+        out.append(batch -> listing.view());
+        for (int index : batch -> usedSymbols) symbolTable[index].used = true;
+    }
+    reader.join();
+    relocator.join();
+}
 
-            } else if (addressMode[0] == 'I') {
-                // Handle 'I' address mode (immediate)
-                // Check for illegal immediate operand
-                if (address % 1000 >= 900) {
-                    // Adjust the address to the error condition
-                    address = address / 1000 * 1000 + 999;
-                    errorString = "Error: Illegal immediate operand; treated as 999";
-                    errorExists = true;
-                }
-                // Use the address as-is
-                finalAddress = address;
-
-            } else if (addressMode[0] == 'E') {
-                // Handle 'E' address mode (external)
-                string externalSymbol;  // Variable to store the external symbol being referenced
-                try {
-                    // Attempt to resolve the external symbol reference
-                    // Get the external symbol from the operand index
-                    externalSymbol = externalSymbols.at(operand);
-                    // Add the operand index to the external references vector
-                    externalReferences.push_back(operand);
-
-                    // Flag to indicate if the symbol is not found in the symbol table
-                    bool notfound = true;
-                    // Attempt to find the symbol in the symbol table and compute the final address
-                    for (int j = 0; j < symbolTable.size(); j++) {
-                        // Get the current symbol from the symbol table
-                        Symbol currentSymbol = symbolTable[j];
-                        if (currentSymbol.value.compare(externalSymbol) == 0) { 
-                            // Compute the final address using the symbol's address 
-                            finalAddress = (opcode * 1000) + currentSymbol.Addr;
-                            notfound = false;
-                            // Mark the symbol as used
-                            symbolTable[j].used = true;
-                            break;
-                        }
-                    }
-                    if (notfound) {
-                        // If the symbol is not found in the symbol table
-                        errorString = "Error: " + externalSymbol + " is not defined; zero used";
-                        // Set the error flag and final address with operand set to 0
-                        errorExists = true;
-                        finalAddress = opcode * 1000 + 0;
-                    }
 
-                } catch(const exception& e) {
-                    // Handle exceptions for external operand exceeding the length of the uselist
-                    errorString = "Error: External operand exceeds length of uselist; treated as relative=0";
-                    errorExists = true;
-                    // Set the final address (with relative address = 0)
-                    finalAddress = opcode * 1000 + baseAddress;
-                }
+// Function representing the second pass of the two-pass linker, generates the memory map
+// from the modules recorded by the first pass. Only a streaming link touches the input again.
+// With more than one thread, modules are relocated concurrently into per-batch buffers that
+// are printed in module order, so the output is identical to the serial run. A streaming link
+// relocates in a pipeline instead, see relocateModulesStreaming.
+void secondPass(LinkContext& context, const vector<ModuleIR>& modules, SymbolTable& symbolTable, OutputBuffer& out) {
+    int threadCount = context.threadCount;
+    LinkCache* cache = context.cache;
+    int moduleCount = modules.size();
+    // The cache only knows the modules when it saw all of them during the first pass
+    if (cache && !cache -> covers(moduleCount)) cache = nullptr;
 
-            } else;
-            // End of address mode handling
-            
-            // Print the memory map entry with the memory map index and the final address
-            cout << setfill('0') << setw(3) << memoryMapIndex << ":" << " " << setfill('0') << setw(4) << finalAddress;
-
-            // If there's any error, print the corresponding error message
-            if (opcodeErrorExists || errorExists) {
-                cout << " " << errorString;
-            } cout << endl;
-
-            // Reset error variables for the next iteration
-            errorString = "";
-            errorExists = false;            
-            // Increment the memory map index
-            memoryMapIndex++;
-        }
-
-        // Update the base address for the next module
-        baseAddress = baseAddress + instructionCount;
-
-        // Warn about unused external symbols in the module's uselist
-        for (int i = 0; i < externalSymbols.size(); i++) {
-            // Flag to indicate if the symbol was used
-            bool found = false;
-            for (int j = 0; j < externalReferences.size(); j++) {
-                // Set the found flag to true if the symbol was used
-                if (i == externalReferences[j]) found = true;
-            }
-            // Print a warning message
-            if(!found) cout << "Warning: Module " << moduleNumber - 1 << ": uselist[" << i << "]=" << externalSymbols[i] << " was not used\n";   
+    // Memory map index of the first instruction of each module
+    vector<int64_t> mapStart(moduleCount);
+    int64_t memoryMapIndex = 0;
+    for (int i = 0; i < moduleCount; i++) {
+        mapStart[i] = memoryMapIndex;
+        if (context.moduleBases[i].removed) continue;
+        memoryMapIndex += modules[i].instructionsStored() ? modules[i].instructions.size() : max(0, modules[i].instructionCount);
+    }
+
+    if (context.image) {
+        context.image -> words.assign(memoryMapIndex, 0);
+        context.image -> errors.assign(memoryMapIndex, relocationValid);
+        if (context.image -> recordFixups) context.image -> fixups.assign(memoryMapIndex, fixupNone);
+    }
+    if (context.record) {
+        context.record -> memoryMap.assign(memoryMapIndex, MemoryWord());
+        context.record -> moduleDiagnostics.assign(moduleCount, {});
+    }
+
+    // A module larger than the machine (512 words) stops the link once the modules before it are printed
+    int oversizedModule = -1;
+    for (int i = 0; i < moduleCount && oversizedModule == -1; i++) {
+        if (modules[i].instructionCount > context.machine.memorySize && !context.moduleBases[i].removed) oversizedModule = i;
+    }
+    if (oversizedModule != -1) moduleCount = oversizedModule;
+
+    if (context.streaming) {
+        relocateModulesStreaming(context, modules, moduleCount, mapStart, symbolTable, out, cache);
+    } else if (threadCount <= 1 || moduleCount < 2) {
+        vector<int> usedSymbols;
+        RelocationScratch scratch;
+        for (int i = 0; i < moduleCount; i++) {
+            relocateModuleCached(context, modules[i], i, context.moduleBases[i].moduleBaseAddr, mapStart[i], symbolTable, out,
+                                 usedSymbols, scratch, cache);
         }
+        for (int index : usedSymbols) symbolTable[index].used = true;
+    } else {
+        relocateModulesParallel(context, modules, moduleCount, mapStart, symbolTable, out, threadCount, cache);
     }
 
-    // Return the updated symbol table
-    return symbolTable;
+    // The record keeps what was listed: the memory map up to where the link stopped, and the
+    // warnings of the modules relocated, in module order
+    if (context.record) {
+        LinkRecord& record = *context.record;
+        if (oversizedModule != -1) record.memoryMap.resize(mapStart[oversizedModule]);
+        for (int i = 0; i < moduleCount; i++) {
+            for (string& diagnostic : record.moduleDiagnostics[i]) record.diagnostics.push_back(move(diagnostic));
+        }
+        record.moduleDiagnostics.clear();
+    }
+
+    if (oversizedModule != -1) {
+        Token instructionToken;
+        instructionToken.setToken(modules[oversizedModule].instructionCountLine, modules[oversizedModule].instructionCountOffset, "");
+        __parseerror(6, instructionToken, modules[oversizedModule].fileIndex);
+    }
 }
@@ -3,15 +3,75 @@
 
 #include <vector>
 #include "Token.h"
+#include "SymbolTable.h"
+#include "OutputBuffer.h"
+#include "LinkCache.h"
+#include "MachineModel.h"
 
 using namespace std;
 
+class LinkContext;
+class LinkInput;
+
+// Class representing a parse error, thrown by __parseerror and reported by main
+class ParseError {
+public:
+    int errcode;
+    int lineNumber;
+    int lineOffset;
+    int fileIndex = 0;      // Input file the position refers to
+    string fileName;        // Named in the message when set, i.e. when several files are linked
+
+    string message() const;
+};
+
+// Class representing every parse error of a link with --keep-going, thrown by the first pass in
+// input order
+class ParseErrorList {
+public:
+    vector<ParseError> errors;
+};
+
+// Class representing an input that is neither a valid object nor a valid library, thrown by the first pass
+class InputError {
+public:
+    string fileName;
+
+    string message() const { return "Invalid object file " + fileName; }
+};
+
+// Class holding the modules parsed from one range of the input. A parse error ends the range:
+// the module it occurred in is kept only if its header (and so its instruction count) was read.
+// The modules' lists and names are stored in the range's arena.
+class ParsedRange {
+public:
+    vector<ModuleIR> modules;
+    shared_ptr<Arena> storage;          // Created by the first module stored
+    vector<const char*> moduleStarts;   // Start of each module, including one whose header failed
+    const char* end = nullptr;          // Where the next module starts, or the end of the input
+    bool failed = false;
+    bool failedInHeader = false;
+    ParseError error;
+    const char* errorPosition = nullptr;    // Token the error was reported at, the end of the input for EOF
+    vector<ParseError> laterErrors;     // Errors after the first, only looked for with --keep-going
+
+    // Function to return the arena the range's modules are stored in
+    Arena& arena() {
+        if (!storage) storage = make_shared<Arena>();
+        return *storage;
+    }
+};
+
 // All function prototypes required
-void __parseerror(int errcode, Token token);
+void __parseerror(int errcode, Token token, int fileIndex = 0);
 int readInteger(Token token);
-string readSymbol(Token token);
-string readMARIE(Token token);
-vector<Symbol> firstPass(string fileName);
-vector<Symbol> secondPass(string fileName, vector<Symbol> symbolTable);
+int64_t readAddress(Token token, const MachineModel& machine);
+string_view readSymbol(Token token, const MachineModel& machine);
+char readMARIE(Token token);
+InstructionStore moduleInstructions(const MachineModel& machine, const ModuleIR& module, Arena& arena);
+bool readModules(LinkContext& context, const Tokenizer& input, ParsedRange& parsed, int threadCount = 1,
+                 bool stopOnTooManyInstructions = false, LinkCache* cache = nullptr);
+SymbolTable firstPass(LinkContext& context, const vector<LinkInput>& inputs, vector<ModuleIR>& modules, OutputBuffer& out);
+void secondPass(LinkContext& context, const vector<ModuleIR>& modules, SymbolTable& symbolTable, OutputBuffer& out);
 
 #endif // PARSER_H
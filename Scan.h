@@ -0,0 +1,144 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Character kernels of the tokenizer and the token readers. Where SSE2 is available (every
+// x86-64 target) they look at 16 bytes at a time, and digit runs are converted 8 at a time in a
+// 64-bit register; elsewhere, and for the last bytes of an input, they fall back to scalar loops.
+// Loads never reach past the end of the range they are given. The kernels are forced inline so
+// that they cost no call even in a build without optimisation.
+
+#define SCAN_INLINE inline __attribute__((always_inline))
+
+#if defined(__SSE2__)
+// Byte vectors of the kernels, built once rather than on every call
+static const __m128i spaceBytes = _mm_set1_epi8(' ');
+static const __m128i tabBytes = _mm_set1_epi8('\t');
+static const __m128i newlineBytes = _mm_set1_epi8('\n');
+static const __m128i zeroBytes = _mm_set1_epi8('0');
+static const __m128i lowerCaseBits = _mm_set1_epi8(0x20);
+static const __m128i letterBytes = _mm_set1_epi8('a');
+static const __m128i signBits = _mm_set1_epi8((char) 0x80);
+static const __m128i digitLimit = _mm_set1_epi8((char) (10 ^ 0x80));   // Limits with the sign bit flipped
+static const __m128i letterLimit = _mm_set1_epi8((char) (26 ^ 0x80));
+#endif
+
+
+// Function to tell whether c separates tokens
+SCAN_INLINE bool isSeparator(char c) {
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+SCAN_INLINE bool isAsciiDigit(char c) {
+    return (unsigned char) (c - '0') < 10;
+}
+
+SCAN_INLINE bool isAsciiLetter(char c) {
+    return (unsigned char) ((c | 0x20) - 'a') < 26;
+}
+
+
+// Function to return the first separator in [p, end), or end if there is none
+SCAN_INLINE const char* findSeparator(const char* p, const char* end) {
+#if defined(__SSE2__)
+    while (end - p >= 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*) p);
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, spaceBytes), _mm_cmpeq_epi8(block, tabBytes)),
+                                    _mm_cmpeq_epi8(block, newlineBytes));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask != 0) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while (p < end && !isSeparator(*p)) p++;
+    return p;
+}
+
+
+// Function to return the length of the leading run of ASCII letters and digits in text
+inline size_t alphanumericPrefix(string_view text) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+#if defined(__SSE2__)
+    // x < n as unsigned bytes is (x ^ 0x80) < (n ^ 0x80) as signed bytes
+    while (end - p >= 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*) p);
+        __m128i digit = _mm_xor_si128(_mm_sub_epi8(block, zeroBytes), signBits);
+        __m128i letter = _mm_xor_si128(_mm_sub_epi8(_mm_or_si128(block, lowerCaseBits), letterBytes), signBits);
+        __m128i valid = _mm_or_si128(_mm_cmplt_epi8(digit, digitLimit), _mm_cmplt_epi8(letter, letterLimit));
+        int mask = ~_mm_movemask_epi8(valid) & 0xFFFF;
+        if (mask != 0) return p - text.data() + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while (p < end && (isAsciiDigit(*p) || isAsciiLetter(*p))) p++;
+    return p - text.data();
+}
+
+
+// Function to convert 8 ASCII digits at once. Returns false, leaving value alone, if any of the
+// bytes is not a digit.
+inline bool readEightDigits(const char* p, uint64_t& value) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t chunk;
+    memcpy(&chunk, p, 8);
+    // Every byte is 0x30..0x39: its high nibble is 3 and adding 6 does not carry out of the low one
+    if (((chunk & 0xF0F0F0F0F0F0F0F0ULL) | (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) != 0x3333333333333333ULL) {
+        return false;
+    }
+    chunk -= 0x3030303030303030ULL;
+    chunk = chunk * 10 + (chunk >> 8);     // Pairs of digits
+    chunk = (((chunk & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32)))
+             + (((chunk >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+    value = chunk;
+    return true;
+#else
+    for (int i = 0; i < 8; i++) {
+        if (!isAsciiDigit(p[i])) return false;
+    }
+    uint64_t digits = 0;
+    for (int i = 0; i < 8; i++) digits = digits * 10 + (p[i] - '0');
+    value = digits;
+    return true;
+#endif
+}
+
+
+// Function to read a decimal integer the way strtoll reads one: leading white space and a sign
+// are skipped and the digits up to the first other character are converted. Returns false if
+// there are no digits or the value lies outside [smallest, largest], which must include 0.
+inline bool parseDecimal(string_view text, int64_t smallest, int64_t largest, int64_t& value) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end && (*p == '\v' || *p == '\f' || *p == '\r' || isSeparator(*p))) p++;
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) p++;
+    if (p == end || !isAsciiDigit(*p)) return false;
+
+    uint64_t limit = negative ? 0 - (uint64_t) smallest : (uint64_t) largest;
+    uint64_t magnitude = 0;
+    uint64_t eight;
+    while (end - p >= 8 && readEightDigits(p, eight)) {
+        if (magnitude > (limit - min(limit, eight)) / 100000000 || eight > limit) return false;
+        magnitude = magnitude * 100000000 + eight;
+        p += 8;
+    }
+    for (; p < end && isAsciiDigit(*p); p++) {
+        uint64_t digit = *p - '0';
+        if (magnitude > (limit - min(limit, digit)) / 10 || digit > limit) return false;
+        magnitude = magnitude * 10 + digit;
+    }
+    value = negative ? (int64_t) (0 - magnitude) : (int64_t) magnitude;
+    return true;
+}
+
+#endif // SCAN_H
@@ -0,0 +1,56 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+
+// Class implementing a bounded queue between exactly one producing and one consuming thread. The
+// slots form a ring indexed by two counters that only ever grow, each written by one side, so
+// neither side takes a lock. A producer finding the queue full waits for the consumer to free a
+// slot, and a consumer finding it empty waits for the producer: that wait is the backpressure
+// that bounds how far a fast stage can run ahead of a slow one. Waiting blocks on the counter of
+// the other side (atomic wait) instead of spinning.
+template <typename T> class SpscQueue {
+private:
+    vector<T> slots;
+    alignas(64) atomic<size_t> head{0};     // Items taken so far, written by the consumer
+    alignas(64) atomic<size_t> tail{0};     // Items added so far, written by the producer
+
+public:
+    explicit SpscQueue(size_t capacity) : slots(capacity) {}
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Function to add an item, waiting while the queue is full. Called by the producer only.
+    void push(T item) {
+        size_t position = tail.load(memory_order_relaxed);
+        size_t taken = head.load(memory_order_acquire);
+        while (position - taken == slots.size()) {
+            head.wait(taken, memory_order_acquire);
+            taken = head.load(memory_order_acquire);
+        }
+        slots[position % slots.size()] = move(item);
+        tail.store(position + 1, memory_order_release);
+        tail.notify_one();
+    }
+
+    // Function to take the oldest item, waiting while the queue is empty. Called by the consumer only.
+    T pop() {
+        size_t position = head.load(memory_order_relaxed);
+        size_t added = tail.load(memory_order_acquire);
+        while (added == position) {
+            tail.wait(added, memory_order_acquire);
+            added = tail.load(memory_order_acquire);
+        }
+        T item = move(slots[position % slots.size()]);
+        head.store(position + 1, memory_order_release);
+        head.notify_one();
+        return item;
+    }
+};
+
+#endif // SPSC_QUEUE_H
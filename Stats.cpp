@@ -0,0 +1,150 @@
+#include "Stats.h"
+#include "LinkCache.h"
+#include "MachineModel.h"
+#include "Parser.h"
+#include "OutputBuffer.h"
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fcntl.h>
+
+using namespace std;
+
+static const auto linkStart = chrono::steady_clock::now();
+static atomic<int> traceThreads{0};
+
+static atomic<int> allocationCounters{0};       // Live AllocationCounters, allocations are only counted while one lives
+static atomic<uint64_t> allocationCount{0};
+
+
+// Function to count one allocation of the process, while a counter lives
+void countAllocation() {
+    if (allocationCounters.load(memory_order_relaxed)) allocationCount.fetch_add(1, memory_order_relaxed);
+}
+
+
+AllocationCounter::AllocationCounter(bool active) : active(active) {
+    if (!active) return;
+    allocationCounters++;
+    start = allocationCount.load();
+}
+
+AllocationCounter::~AllocationCounter() {
+    if (active) allocationCounters--;
+}
+
+// Function to return the allocations made since the counter was created
+uint64_t AllocationCounter::count() const {
+    return active ? allocationCount.load() - start : 0;
+}
+
+
+// Function to return microseconds since the link started, the time base of the trace
+double traceClock() {
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - linkStart).count();
+}
+
+
+// Function to return the CPU time of the process in milliseconds
+double processCpuMilliseconds() {
+    timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec * 1e-6;
+}
+
+
+// Function to add the time of one run of a phase
+void LinkStats::addPhase(const string& name, double wallMilliseconds, double cpuMilliseconds) {
+    for (PhaseRecord& phase : phases) {
+        if (phase.name == name) {
+            phase.wallMilliseconds += wallMilliseconds;
+            phase.cpuMilliseconds += cpuMilliseconds;
+            return;
+        }
+    }
+    phases.push_back(PhaseRecord{name, wallMilliseconds, cpuMilliseconds});
+}
+
+
+// Function to record a trace event on the calling thread. Threads are numbered in the order they
+// record their first event.
+void LinkStats::addEvent(const char* name, double startMicroseconds, double durationMicroseconds) {
+    thread_local int thread = traceThreads++;
+    lock_guard<mutex> lock(eventMutex);
+    events.push_back(TraceEvent{name, thread, startMicroseconds, durationMicroseconds});
+}
+
+
+// Function to format a decimal for the JSON report and the trace
+static string formatDecimal(double value) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.3f", value);
+    return text;
+}
+
+
+// Function to describe the link as JSON. Relocations are the instructions whose address the
+// linker computes from a base or a symbol: legal M, R and E instructions.
+string LinkStats::json(const vector<ModuleIR>& modules, const LinkCache* cache, const MachineModel& machine) const {
+    string text = "{\n  \"phases\": {";
+    for (size_t p = 0; p < phases.size(); p++) {
+        text += p ? ",\n" : "\n";
+        text += "    \"" + phases[p].name + "\": {\"wallMs\": " + formatDecimal(phases[p].wallMilliseconds)
+              + ", \"cpuMs\": " + formatDecimal(phases[p].cpuMilliseconds) + "}";
+    }
+    text += "\n  },\n  \"counters\": {\n";
+    text += "    \"bytesRead\": " + to_string(bytesRead.load()) + ",\n";
+    text += "    \"tokens\": " + to_string(tokens.load()) + ",\n";
+    text += "    \"symbolProbes\": " + to_string(symbolProbes.load()) + ",\n";
+    text += "    \"allocations\": " + to_string(allocations.load()) + ",\n";
+    text += "    \"bytesWritten\": " + to_string(bytesWritten.load()) + "\n  },\n";
+
+    uint64_t totalRelocations = 0;
+    string perModule;
+    for (size_t m = 0; m < modules.size(); m++) {
+        uint64_t relocations = 0;
+        Arena reloaded;     // Holds the instructions of a module the first pass only checked
+        InstructionStore instructions = moduleInstructions(machine, modules[m], reloaded);
+        for (size_t i = 0; i < instructions.size(); i++) {
+            char mode = instructions.modes[i];
+            bool relocated = mode == 'M' || mode == 'R' || mode == 'E';
+            if (relocated && instructions.words[i] <= machine.largestInstruction()) relocations++;
+        }
+        totalRelocations += relocations;
+        perModule += (m ? ", " : "") + to_string(relocations);
+    }
+    text += "  \"modules\": {\n    \"count\": " + to_string(modules.size()) + ",\n";
+    text += "    \"relocations\": " + to_string(totalRelocations) + ",\n";
+    text += "    \"relocationsPerModule\": [" + perModule + "]\n  }";
+
+    if (cache) {
+        size_t moduleHits = cache -> moduleHits, relocationHits = cache -> relocationHits;
+        double hitRate = modules.empty() ? 0 : 100.0 * moduleHits / modules.size();
+        text += ",\n  \"cache\": {\"modulesReused\": " + to_string(moduleHits) + ", \"relocationsReused\": "
+              + to_string(relocationHits) + ", \"hitRatePercent\": " + formatDecimal(hitRate) + "}";
+    }
+    return text + "\n}\n";
+}
+
+
+// Function to write the recorded events as a Chrome trace-event file
+bool LinkStats::writeTrace(const string& fileName) {
+    int fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    OutputBuffer out(fd);
+    out.append("{\"traceEvents\": [");
+    lock_guard<mutex> lock(eventMutex);
+    for (size_t e = 0; e < events.size(); e++) {
+        const TraceEvent& event = events[e];
+        out.append(e ? ",\n" : "\n");
+        out.append("{\"name\": \"");
+        out.append(event.name);
+        out.append("\", \"ph\": \"X\", \"pid\": 1, \"tid\": ");
+        out.appendNumber(event.thread);
+        out.append(", \"ts\": " + formatDecimal(event.startMicroseconds));
+        out.append(", \"dur\": " + formatDecimal(event.durationMicroseconds) + "}");
+    }
+    out.append("\n]}\n");
+    out.flush();
+    return close(fd) == 0;
+}
@@ -0,0 +1,125 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Token.h"
+
+using namespace std;
+
+class LinkCache;
+class MachineModel;
+
+
+// Class representing the time spent in one phase of the link
+class PhaseRecord {
+public:
+    string name;
+    double wallMilliseconds = 0;
+    double cpuMilliseconds = 0;     // CPU time of the whole process, all threads
+};
+
+
+// Class representing one complete event of a Chrome trace
+class TraceEvent {
+public:
+    const char* name;
+    int thread;
+    double startMicroseconds;
+    double durationMicroseconds;
+};
+
+
+// Class collecting the instrumentation of one link. Counters are atomic so worker threads can add
+// to them; every update site checks enabled first, so a link without --stats pays one
+// predictable branch per update.
+class LinkStats {
+private:
+    mutex eventMutex;
+    vector<TraceEvent> events;
+
+public:
+    atomic<uint64_t> bytesRead{0};
+    atomic<uint64_t> tokens{0};
+    atomic<uint64_t> symbolProbes{0};   // Hash slots inspected by symbol table lookups and inserts
+    atomic<uint64_t> allocations{0};    // Calls to operator new in the whole process during the link, see AllocationCounter
+    atomic<uint64_t> bytesWritten{0};
+    vector<PhaseRecord> phases;         // In the order the phases first ran, only touched by the linking thread
+    bool enabled = false;               // Set by --stats and --trace; without it nothing is recorded
+    bool tracing = false;
+
+    void addPhase(const string& name, double wallMilliseconds, double cpuMilliseconds);
+    void addEvent(const char* name, double startMicroseconds, double durationMicroseconds);
+    string json(const vector<ModuleIR>& modules, const LinkCache* cache, const MachineModel& machine) const;
+    bool writeTrace(const string& fileName);
+};
+
+
+// Class counting the allocations of the process while it lives, if it is active. Allocations are
+// only seen in programs linked with AllocationHook.cpp, which replaces the global operator new;
+// elsewhere the count stays 0. Operator new is global, so concurrent links in one process see
+// each other's allocations.
+class AllocationCounter {
+private:
+    bool active;
+    uint64_t start = 0;
+
+public:
+    explicit AllocationCounter(bool active);
+    ~AllocationCounter();
+    uint64_t count() const;
+};
+
+
+// Function to count one allocation, called by the operator new of AllocationHook.cpp
+void countAllocation();
+
+// Function to return microseconds since the link started, the time base of the trace
+double traceClock();
+
+// Function to return the CPU time of the process in milliseconds
+double processCpuMilliseconds();
+
+
+// Class recording the duration of a scope as a trace event, on any thread
+class TraceScope {
+private:
+    LinkStats& stats;
+    const char* name;
+    double start;
+
+public:
+    TraceScope(LinkStats& stats, const char* name) : stats(stats), name(name), start(stats.tracing ? traceClock() : 0) {}
+    ~TraceScope() {
+        if (stats.tracing) stats.addEvent(name, start, traceClock() - start);
+    }
+};
+
+
+// Class recording the wall and CPU time of a phase of the link, on the linking thread. A phase
+// that runs several times (output) adds up.
+class PhaseScope {
+private:
+    LinkStats& stats;
+    const char* name;
+    double start = 0;
+    double cpuStart = 0;
+
+public:
+    PhaseScope(LinkStats& stats, const char* name) : stats(stats), name(name) {
+        if (!stats.enabled) return;
+        start = traceClock();
+        cpuStart = processCpuMilliseconds();
+    }
+    ~PhaseScope() {
+        if (!stats.enabled) return;
+        double end = traceClock();
+        stats.addPhase(name, (end - start) / 1000, processCpuMilliseconds() - cpuStart);
+        if (stats.tracing) stats.addEvent(name, start, end - start);
+    }
+};
+
+#endif // STATS_H
@@ -0,0 +1,132 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <vector>
+#include "Token.h"
+#include "Stats.h"
+
+using namespace std;
+
+
+// Class representing a symbol name stored inline. With the default machine model names are
+// limited to 16 characters, so every valid name fits in two zero-padded 64-bit words and compares
+// without touching the heap. Longer names keep their first 16 characters and a hash of the rest;
+// keys that compare equal then still need their full names compared.
+class SymbolKey {
+public:
+    static constexpr size_t capacity = 16;
+
+    uint64_t words[2] = {0, 0};
+    uint64_t tail = 0;          // Hash of the characters after the first 16, 0 for short names
+    uint32_t length = 0;
+
+    // Function to load a name into the key
+    void assign(string_view name) {
+        words[0] = words[1] = 0;
+        memcpy(words, name.data(), min(name.size(), capacity));
+        tail = 0;
+        for (size_t i = capacity; i < name.size(); i++) tail = (tail ^ (unsigned char) name[i]) * 0x100000001B3ULL;
+        length = name.size();
+    }
+
+    // Function to tell whether the key holds the whole name
+    bool complete() const { return length <= capacity; }
+
+    uint64_t hash() const {
+        uint64_t h = (words[0] ^ (words[1] * 0x9E3779B97F4A7C15ULL) ^ tail ^ length) * 0xFF51AFD7ED558CCDULL;
+        return h ^ (h >> 32);
+    }
+
+    bool operator==(const SymbolKey& other) const {
+        return words[0] == other.words[0] && words[1] == other.words[1] && tail == other.tail && length == other.length;
+    }
+};
+
+
+// Class implementing the symbol table: distinct symbols in first-definition order, indexed by an
+// open-addressing hash table over their inline keys. The table keeps its own copy of the names,
+// so it does not depend on the inputs or the modules the symbols came from.
+class SymbolTable {
+private:
+    Arena names;                // Names of the symbols
+    vector<Symbol> symbols;     // Distinct symbols, in the order they were first defined
+    vector<SymbolKey> keys;     // Interned name of each symbol, parallel to symbols
+    vector<int> slots;          // Hash slots holding indices into symbols, -1 when empty
+    LinkStats* stats = nullptr; // Counts the probes of a link run with --stats
+
+    // Function to tell whether the symbol at index has the given key and name
+    bool matches(int index, const SymbolKey& key, string_view name) const {
+        return keys[index] == key && (key.complete() || symbols[index].value == name);
+    }
+
+    // Function to return the slot holding the key, or the empty slot where it belongs
+    size_t probe(const SymbolKey& key, string_view name) const {
+        size_t mask = slots.size() - 1;
+        size_t slot = key.hash() & mask;
+        uint64_t probes = 1;
+        while (slots[slot] != -1 && !matches(slots[slot], key, name)) slot = (slot + 1) & mask, probes++;
+        if (stats) stats -> symbolProbes.fetch_add(probes, memory_order_relaxed);
+        return slot;
+    }
+
+    // Function to double the number of slots and reinsert every symbol
+    void grow() {
+        slots.assign(slots.empty() ? 64 : slots.size() * 2, -1);
+        for (int i = 0; i < keys.size(); i++) slots[probe(keys[i], symbols[i].value)] = i;
+    }
+
+public:
+    // Function to count the probes of lookups and inserts in stats, or stop counting with nullptr
+    void countProbes(LinkStats* stats) { this -> stats = stats; }
+
+    // Function to size an empty table for count symbols, so adding them never grows it
+    void reserve(size_t count) {
+        size_t slotCount = 64;
+        while (slotCount < 2 * count) slotCount *= 2;
+        slots.assign(slotCount, -1);
+        symbols.reserve(count);
+        keys.reserve(count);
+    }
+
+    // Function to find a symbol by name, returns its index or -1 if it is not defined
+    int find(string_view name) const {
+        if (slots.empty()) return -1;
+        SymbolKey key;
+        key.assign(name);
+        return slots[probe(key, name)];
+    }
+
+    // Function to add a definition. The first definition of a name wins: a later one only flags
+    // the existing symbol as alreadyDefined. Returns false if the name was already defined.
+    bool insert(const Symbol& symbol) {
+        SymbolKey key;
+        key.assign(symbol.value);
+        if (2 * (keys.size() + 1) > slots.size()) grow();
+
+        size_t slot = probe(key, symbol.value);
+        if (slots[slot] != -1) {
+            symbols[slots[slot]].alreadyDefined = true;
+            return false;
+        }
+        slots[slot] = symbols.size();
+        symbols.push_back(symbol);
+        symbols.back().value = names.store(symbol.value);
+        keys.push_back(key);
+        return true;
+    }
+
+    size_t size() const { return symbols.size(); }
+    Symbol& operator[](size_t index) { return symbols[index]; }
+    const Symbol& operator[](size_t index) const { return symbols[index]; }
+
+    vector<Symbol>::iterator begin() { return symbols.begin(); }
+    vector<Symbol>::iterator end() { return symbols.end(); }
+    vector<Symbol>::const_iterator begin() const { return symbols.begin(); }
+    vector<Symbol>::const_iterator end() const { return symbols.end(); }
+};
+
+#endif // SYMBOL_TABLE_H
@@ -0,0 +1,132 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+// Class implementing a fixed-size pool of worker threads draining a shared task queue
+class ThreadPool {
+private:
+    vector<thread> workers;
+    deque<function<void()>> tasks;
+    mutex queueMutex;
+    condition_variable taskAvailable;   // Signalled when a task is queued or the pool stops
+    condition_variable allIdle;         // Signalled when the queue drains and no task is running
+    int runningTasks = 0;
+    bool stopping = false;
+
+    // Function run by every worker: take tasks until the pool is stopped
+    void workerLoop() {
+        while (true) {
+            function<void()> task;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                taskAvailable.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) return;
+                task = move(tasks.front());
+                tasks.pop_front();
+                runningTasks++;
+            }
+            task();
+            {
+                lock_guard<mutex> lock(queueMutex);
+                runningTasks--;
+                if (tasks.empty() && runningTasks == 0) allIdle.notify_all();
+            }
+        }
+    }
+
+public:
+    explicit ThreadPool(int threadCount) {
+        for (int i = 0; i < threadCount; i++) workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Function to queue a task for the workers
+    void submit(function<void()> task) {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            tasks.push_back(move(task));
+        }
+        taskAvailable.notify_one();
+    }
+
+    // Function to block until every submitted task has finished
+    void wait() {
+        unique_lock<mutex> lock(queueMutex);
+        allIdle.wait(lock, [this] { return tasks.empty() && runningTasks == 0; });
+    }
+
+    int size() const {
+        return workers.size();
+    }
+
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        taskAvailable.notify_all();
+        for (thread& worker : workers) worker.join();
+    }
+};
+
+
+
+// Class implementing work stealing over the indices [0, count) for a fixed set of workers. Every
+// worker owns a contiguous share of the indices and takes them from its front, so it works through
+// neighbouring items; a worker whose share is used up steals from the back of another share. A
+// share is a single word holding its front and back, moved by compare-and-swap, so neither
+// taking nor stealing locks. At most 2^32 - 1 indices are supported.
+class WorkStealingRanges {
+private:
+    vector<atomic<uint64_t>> shares;    // Front in the high half, back (exclusive) in the low half
+
+    static uint64_t pack(uint64_t front, uint64_t back) { return front << 32 | back; }
+
+    // Function to take an index from the front or the back of a share, returns false if it is empty
+    bool takeFrom(atomic<uint64_t>& share, bool fromFront, size_t& index) {
+        uint64_t bounds = share.load(memory_order_relaxed);
+        while (true) {
+            uint64_t front = bounds >> 32;
+            uint64_t back = bounds & 0xFFFFFFFF;
+            if (front >= back) return false;
+            uint64_t taken = fromFront ? pack(front + 1, back) : pack(front, back - 1);
+            if (share.compare_exchange_weak(bounds, taken, memory_order_relaxed)) {
+                index = fromFront ? front : back - 1;
+                return true;
+            }
+        }
+    }
+
+public:
+    WorkStealingRanges(size_t count, int workerCount) : shares(max(1, workerCount)) {
+        for (size_t w = 0; w < shares.size(); w++) {
+            shares[w].store(pack(count * w / shares.size(), count * (w + 1) / shares.size()));
+        }
+    }
+
+    // Function to give worker its next index: the front of its own share, or else one stolen from
+    // the next non-empty share after it. Returns false once every share is empty.
+    bool take(int worker, size_t& index) {
+        if (takeFrom(shares[worker], true, index)) return true;
+        for (size_t step = 1; step < shares.size(); step++) {
+            if (takeFrom(shares[(worker + step) % shares.size()], false, index)) return true;
+        }
+        return false;
+    }
+};
+
+#endif // THREAD_POOL_H
@@ -1,10 +1,17 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <fstream>
 #include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Scan.h"
+#include "Arena.h"
 
 using namespace std;
 
@@ -14,9 +21,9 @@ class Token {
 public:
     int lineNumber;
     int lineOffset;
-    string tokenContents;
+    string_view tokenContents;  // View into the tokenizer's input, valid while the tokenizer lives
 
-    void setToken(int lineNumber, int lineOffset, string tokenContents) {
+    void setToken(int lineNumber, int lineOffset, string_view tokenContents) {
         this -> lineNumber = lineNumber;
         this -> lineOffset = lineOffset;
         this -> tokenContents = tokenContents;
@@ -24,11 +31,11 @@ public:
 };
 
 
-// Class representing one symbol
+// Class representing one symbol of the symbol table
 class Symbol {
 public:
-    string value;
-    int Addr;
+    string_view value;      // Stored in the symbol table
+    int64_t Addr;
     int relativeAddr;
     int moduleNumber;
     bool alreadyDefined = false;
@@ -39,105 +46,212 @@ public:
 // Class representing one module (module_base)
 class Module {
 public:
-    int moduleBaseAddr;
+    int64_t moduleBaseAddr;
     int moduleSize;
+    bool removed = false;   // Unreachable from the root modules (--gc-modules), neither placed nor relocated
+};
+
+
+// Class holding the instructions of a module as two parallel arrays, the addressing mode of
+// each instruction and its raw instruction word, so the second pass can sweep the words of one
+// addressing mode at a time. Entry i of both arrays is instruction i of the module.
+class InstructionStore {
+public:
+    ArenaList<char> modes;
+    ArenaList<int64_t> words;
+
+    // Function to make room for capacity instructions in arena, emptying the store
+    void reserve(Arena& arena, size_t capacity) {
+        modes.reserve(arena, capacity);
+        words.reserve(arena, capacity);
+    }
+
+    void push_back(Arena& arena, char mode, int64_t word) {
+        modes.push_back(arena, mode);
+        words.push_back(arena, word);
+    }
+
+    size_t size() const { return words.size(); }
+};
+
+
+// Class representing one definition of a module, as read from the input
+class Definition {
+public:
+    string_view value;
+    int relativeAddr;
+};
+
+
+// Class representing one parsed module, built by firstPass and relocated by secondPass. Its lists
+// and names live in the arena of the range it was parsed in, which every module of that range
+// keeps alive. A parsed module is never changed, so modules shared between links are only read.
+class ModuleIR {
+public:
+    ArenaList<Definition> defList;          // Definitions in this module, in input order
+    ArenaList<string_view> useList;         // External symbols referenced by E instructions
+    InstructionStore instructions;          // Instructions, in input order
+    int instructionCount;               // Instruction count as read from the input
+
+    // Positions of the count tokens, for diagnostics
+    int definitionCountLine;
+    int definitionCountOffset;
+    int useCountLine;
+    int useCountOffset;
+    int instructionCountLine;
+    int instructionCountOffset;
+
+    int fileIndex = 0;                  // Input file the module was read from, in command-line order
+    shared_ptr<const Arena> storage;    // Arena holding the lists and names
+
+    // Text of the instructions when the first pass only checked them (--stream) and the second
+    // pass reads them again; a view of the input, valid as long as the input is. Null otherwise.
+    string_view instructionText;
+
+    bool instructionsStored() const { return instructionText.data() == nullptr; }
 };
 
 
 // Class implementing the logic for the tokenizer
+// The input is memory mapped (or read once into a buffer when it cannot be mapped) and scanned
+// in a single forward pass. Tokens are views into that input, so no per-token copies are made.
 class Tokenizer {
 private:
-    ifstream file;
-    string currentLine;
-    size_t lineOffset;
-    size_t lineNumber;
-    char* nextToken;
-    vector<char> lineBuffer;
+    int fd = -1;
+    const char* data = nullptr;     // Start of the input
+    const char* cursor = nullptr;   // Current scan position
+    const char* end = nullptr;      // One past the last input byte
+    size_t mappedLength = 0;        // Length of the mapping, 0 when the fallback buffer is used
+    vector<char> fallbackBuffer;    // Holds the input when mmap is not possible (pipes, empty files)
+
+    int lineNumber = 0;                 // Number of lines started so far
+    bool atLineStart = true;            // True when the cursor sits at the beginning of a line
+    const char* lineAnchor = nullptr;   // First token of the current line, offsets are relative to it
 
+    // Position of the last token read, the end of the input is reported just after it
+    int previousTokenOffset = 1;
     size_t previousTokenLength = 0;
-    size_t previousTokenLine = 0;
+    int previousTokenLine = 0;
     bool flagEOF = false;
 
-    // Function to prepare the next token from the current or next line
-    void prepareNextToken() {
-        // If nextToken is null or points to the end of a string, read the next line
-        while (nextToken == nullptr || *nextToken == '\0') {
-            if (!getline(file, currentLine)) {
-                nextToken = nullptr; // End of file reached, no more tokens
-                return;
-            }
-            lineNumber++;
-            lineOffset = 1;
-            lineBuffer.assign(currentLine.begin(), currentLine.end());
-            // Ensure null-termination for string operations
-            lineBuffer.push_back('\0');
-            nextToken = strtok(lineBuffer.data(), " \t");
-        }
+    // Function to release the mapping or buffer and close the file
+    void release() {
+        if (mappedLength > 0) munmap((void*) data, mappedLength);
+        if (fd >= 0) close(fd);
+        fd = -1;
+        mappedLength = 0;
+        data = cursor = end = nullptr;
+        fallbackBuffer.clear();
     }
 
 public:
-    Tokenizer() : lineOffset(1), lineNumber(1), nextToken(nullptr) {}
+    size_t tokensRead = 0;              // Tokens returned so far, for --stats
+
+    Tokenizer() {}
+    Tokenizer(const Tokenizer&) = delete;
+    Tokenizer& operator=(const Tokenizer&) = delete;
 
     bool openFile(const string& filePath) {
-        file.open(filePath);
-        return file.is_open();
-    }
+        release();
+        fd = open(filePath.c_str(), O_RDONLY);
+        if (fd < 0) return false;
 
-    Token getNextToken() {
-        // Prepare the next token if necessary
-        prepareNextToken();
-        
-        Token token;
-        if (nextToken == nullptr) {
-            flagEOF = true;
-            if (lineNumber - 1 > previousTokenLine) {
-                token.setToken(lineNumber - 1, lineOffset, "");
-            } else {
-                token.setToken(lineNumber - 1, lineOffset + previousTokenLength, "");
+        struct stat info;
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+            void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+                mappedLength = info.st_size;
+                data = (const char*) mapping;
+                cursor = data;
+                end = data + mappedLength;
+                return true;
             }
-            // All tokens exhausted
-            return token;
         }
 
-        int currentTokenLength = strlen(nextToken);
-        // Store the current token
-        string tokenValue(nextToken);
-        previousTokenLength = tokenValue.length();
-        previousTokenLine = lineNumber - 1;
-        token.setToken(lineNumber - 1, lineOffset, tokenValue);
-
-        // Update lineOffset for the next token
-        char* remainingLine = strtok(nullptr, "");
-        nextToken = strtok(remainingLine, " \t");
-        if (nextToken != nullptr) {
-            char* nextTokenPosition = strstr(remainingLine, nextToken);
-            lineOffset += currentTokenLength + strlen(remainingLine) - strlen(nextTokenPosition) + 1;
+        // Fall back to reading the whole input into memory
+        char chunk[1 << 16];
+        ssize_t bytesRead;
+        while ((bytesRead = read(fd, chunk, sizeof(chunk))) > 0) {
+            fallbackBuffer.insert(fallbackBuffer.end(), chunk, chunk + bytesRead);
         }
+        data = fallbackBuffer.data();
+        cursor = data;
+        end = data + fallbackBuffer.size();
+        return true;
+    }
 
-        return token;
+    // Function to tokenize input owned by someone else, typically another tokenizer's mapping
+    void openBuffer(const char* begin, const char* end) {
+        release();
+        data = cursor = begin;
+        this -> end = end;
+    }
+
+    // Function to continue scanning at position, which must be the start of a token on line lineNumber
+    void seek(const char* position, int lineNumber) {
+        cursor = position;
+        this -> lineNumber = lineNumber;
+        atLineStart = false;
+        flagEOF = false;
+        previousTokenLine = 0;
+
+        // Offsets are relative to the first token of the line, which may lie before position
+        const char* lineStart = position;
+        while (lineStart > data && lineStart[-1] != '\n') lineStart--;
+        while (lineStart < end && (*lineStart == ' ' || *lineStart == '\t')) lineStart++;
+        lineAnchor = lineStart;
     }
 
-    Token getLastToken() {
-        Token token, lastToken;
-        lastToken.setToken(1, 1, "");
-        // Get the first token
-        token = getNextToken();
-
-        // Continue until no more tokens are available
-        while (!token.tokenContents.empty() && !flagEOF) {
-            lastToken = token;
-            // Get the next token
-            token = getNextToken();
+    const char* inputBegin() const { return data; }
+    const char* inputEnd() const { return end; }
+
+    // Tokens are separated by spaces and tabs, lines by '\n'. Offsets are counted from the first
+    // token of each line, which is always reported at offset 1.
+    Token getNextToken() {
+        Token token;
+
+        // Skip separators, counting every line that is entered
+        while (true) {
+            if (cursor == end) {
+                flagEOF = true;
+                if (lineNumber > previousTokenLine) {
+                    token.setToken(lineNumber, 1, "");
+                } else {
+                    token.setToken(previousTokenLine, previousTokenOffset + previousTokenLength, "");
+                }
+                // All tokens exhausted
+                return token;
+            }
+            if (atLineStart) {
+                lineNumber++;
+                atLineStart = false;
+                lineAnchor = nullptr;
+            }
+            char c = *cursor;
+            if (c == '\n') {
+                atLineStart = true;
+            } else if (c != ' ' && c != '\t') {
+                break;
+            }
+            cursor++;
         }
 
-        // Return the last token encountered
-        return lastToken;
+        // Scan the token itself
+        const char* tokenStart = cursor;
+        cursor = findSeparator(cursor, end);
+        if (lineAnchor == nullptr) lineAnchor = tokenStart;
+
+        previousTokenOffset = (int) (tokenStart - lineAnchor) + 1;
+        previousTokenLength = cursor - tokenStart;
+        previousTokenLine = lineNumber;
+        token.setToken(lineNumber, previousTokenOffset, string_view(tokenStart, previousTokenLength));
+        tokensRead++;
+        return token;
     }
 
     ~Tokenizer() {
-        if (file.is_open()) {
-            file.close();
-        }
+        release();
     }
 };
 
@@ -0,0 +1,349 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include "../Token.h"
+#include "../OutputBuffer.h"
+#include "../LinkContext.h"
+#include "../ConcurrentSymbolTable.h"
+#include "../ThreadPool.h"
+
+using namespace std;
+
+static MachineModel machine;    // Machine the benchmarked inputs are linked for
+static bool concurrentSymbols = false;  // Resolve the symbols of the benchmarked links concurrently
+
+
+// Class measuring the wall and CPU time of one phase
+class PhaseTimer {
+private:
+    chrono::steady_clock::time_point wallStart;
+    double cpuStart;
+
+    static double cpuNow() {
+        timespec now;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+        return now.tv_sec + now.tv_nsec * 1e-9;
+    }
+
+public:
+    PhaseTimer() : wallStart(chrono::steady_clock::now()), cpuStart(cpuNow()) {}
+
+    double wallSeconds() const { return chrono::duration<double>(chrono::steady_clock::now() - wallStart).count(); }
+    double cpuSeconds() const { return cpuNow() - cpuStart; }
+};
+
+
+// Class holding the timings and sizes of one end-to-end link
+class LinkTimes {
+public:
+    double tokenize = 0;        // Wall seconds of each phase
+    double firstPass = 0;
+    double secondPass = 0;
+    double output = 0;
+    double cpu = 0;             // CPU seconds of the whole link, all threads
+    size_t inputBytes = 0;
+    size_t tokens = 0;
+    size_t modules = 0;
+    size_t outputBytes = 0;
+    size_t allocations = 0;     // Heap allocations made by the two passes
+    string error;               // Parse error that stopped the link, if any
+};
+
+
+// Function to link one file the way LinkContext::link does, timing every phase. The output is formatted into
+// memory and written to /dev/null in its own phase, so output cost is not mixed into the passes.
+static LinkTimes linkOnce(const string& fileName, int threadCount) {
+    LinkTimes times;
+    PhaseTimer total;
+
+    // Tokenize the whole input on its own, the passes tokenize it again as part of their work
+    {
+        PhaseTimer timer;
+        Tokenizer tokenizer;
+        if (!tokenizer.openFile(fileName)) {
+            fprintf(stderr, "Unable to open file %s\n", fileName.c_str());
+            exit(1);
+        }
+        times.inputBytes = tokenizer.inputEnd() - tokenizer.inputBegin();
+        while (!tokenizer.getNextToken().tokenContents.empty()) times.tokens++;
+        times.tokenize = timer.wallSeconds();
+    }
+
+    Tokenizer file;
+    file.openFile(fileName);
+    vector<LinkInput> inputs = {LinkInput{fileName, file.inputBegin(), (size_t) (file.inputEnd() - file.inputBegin())}};
+    LinkContext context(machine);
+    context.threadCount = threadCount;
+    context.concurrentSymbols = concurrentSymbols;
+    OutputBuffer out;
+    vector<ModuleIR> modules;
+    SymbolTable symbolTable;
+    try {
+        AllocationCounter allocations(true);
+        PhaseTimer first;
+        symbolTable = firstPass(context, inputs, modules, out);
+        times.firstPass = first.wallSeconds();
+        times.modules = modules.size();
+
+        PhaseTimer second;
+        secondPass(context, modules, symbolTable, out);
+        times.secondPass = second.wallSeconds();
+        times.allocations = allocations.count();
+    } catch (const ParseError& error) {
+        times.error = error.message();
+    } catch (const InputError& error) {
+        times.error = error.message();
+    }
+
+    PhaseTimer output;
+    out.append("Symbol Table\n");
+    for (auto& symbol : symbolTable) {
+        out.append(symbol.value);
+        out.append('=');
+        out.appendNumber(symbol.Addr);
+        out.append('\n');
+    }
+    int devNull = open("/dev/null", O_WRONLY);
+    writeAll(devNull, out.view().data(), out.size());
+    close(devNull);
+    times.output = output.wallSeconds();
+    times.outputBytes = out.size();
+    times.cpu = total.cpuSeconds();
+    return times;
+}
+
+
+// Function to print a byte count with a binary suffix
+static string formatBytes(double bytes) {
+    static const char* suffixes[] = {"B", "KB", "MB", "GB", "TB"};
+    int s = 0;
+    while (bytes >= 1024 && s < 4) bytes /= 1024, s++;
+    char text[32];
+    snprintf(text, sizeof(text), "%.1f%s", bytes, suffixes[s]);
+    return text;
+}
+
+
+// Function to run the end-to-end benchmark on one file, keeping the fastest of repeat links.
+// Without a repeat count, inputs up to 256 MB are linked three times and larger ones once.
+static void benchFile(const string& fileName, int threadCount, int repeat) {
+    struct stat status;
+    if (repeat == 0) repeat = stat(fileName.c_str(), &status) == 0 && status.st_size > (256 << 20) ? 1 : 3;
+    LinkTimes best;
+    double bestTotal = -1;
+    for (int r = 0; r < repeat; r++) {
+        LinkTimes times = linkOnce(fileName, threadCount);
+        double total = times.tokenize + times.firstPass + times.secondPass + times.output;
+        if (bestTotal < 0 || total < bestTotal) best = times, bestTotal = total;
+    }
+    double linkSeconds = best.firstPass + best.secondPass + best.output;
+    printf("%-10s %9zu modules %11zu tokens | tokenize %9.3f ms | firstPass %9.3f ms | secondPass %9.3f ms | "
+           "output %9.3f ms | cpu %9.3f ms | %8.1f MB/s | allocs %9zu (%.4f/token)\n",
+           formatBytes(best.inputBytes).c_str(), best.modules, best.tokens, best.tokenize * 1e3, best.firstPass * 1e3,
+           best.secondPass * 1e3, best.output * 1e3, best.cpu * 1e3, best.inputBytes / 1048576.0 / max(linkSeconds, 1e-9),
+           best.allocations, (double) best.allocations / max<size_t>(best.tokens, 1));
+    if (!best.error.empty()) printf("%-10s stopped by: %s\n", "", best.error.c_str());
+    fflush(stdout);
+}
+
+
+// Function to time fn over iterations calls, keeping the fastest of five rounds, in ns per call
+template <typename Function>
+static double nanosecondsPerCall(size_t iterations, Function fn) {
+    double best = -1;
+    for (int round = 0; round < 5; round++) {
+        PhaseTimer timer;
+        fn();
+        double nanoseconds = timer.wallSeconds() * 1e9 / iterations;
+        if (best < 0 || nanoseconds < best) best = nanoseconds;
+    }
+    return best;
+}
+
+
+// Function to run the microbenchmarks of the tokenizer and the token readers
+static void benchMicro() {
+    const size_t count = 1 << 20;
+
+    // An input of instruction-like tokens, with the separators the generator uses
+    string input;
+    static const char* words[] = {"12", "R", "4013", "symbolName", "E", "9001", "0", "I"};
+    for (size_t i = 0; i < count; i++) {
+        input += words[i % 8];
+        input += i % 16 == 0 ? '\n' : ' ';
+    }
+    Tokenizer tokenizer;
+    vector<Token> numbers, symbols, modes;
+    tokenizer.openBuffer(input.data(), input.data() + input.size());
+    for (Token token = tokenizer.getNextToken(); !token.tokenContents.empty(); token = tokenizer.getNextToken()) {
+        char first = token.tokenContents[0];
+        if (isdigit(first)) numbers.push_back(token);
+        else if (token.tokenContents.size() == 1) modes.push_back(token);
+        else symbols.push_back(token);
+    }
+
+    size_t checksum = 0;    // Consumed so the measured calls are not optimised away
+    AllocationCounter allocations(true);
+    double tokenNs = nanosecondsPerCall(count, [&] {
+        tokenizer.openBuffer(input.data(), input.data() + input.size());
+        while (!tokenizer.getNextToken().tokenContents.empty()) checksum++;
+    });
+    double integerNs = nanosecondsPerCall(numbers.size(), [&] {
+        for (const Token& token : numbers) checksum += readInteger(token);
+    });
+    double symbolNs = nanosecondsPerCall(symbols.size(), [&] {
+        for (const Token& token : symbols) checksum += readSymbol(token, machine).size();
+    });
+    double marieNs = nanosecondsPerCall(modes.size(), [&] {
+        for (const Token& token : modes) checksum += readMARIE(token);
+    });
+
+    printf("Tokenizer::getNextToken %8.2f ns/token\n", tokenNs);
+    printf("readInteger             %8.2f ns/call\n", integerNs);
+    printf("readSymbol              %8.2f ns/call\n", symbolNs);
+    printf("readMARIE               %8.2f ns/call\n", marieNs);
+    printf("heap allocations        %8zu in all of the above\n", (size_t) allocations.count());
+    printf("(checksum %zu)\n", checksum);
+}
+
+
+// Function to check the parallel first pass on one file with chunks of at least chunkSize bytes,
+// far fewer than the linker asks for, so that even a small input is split and its chunk boundaries
+// land inside modules. The listing must match the serial link's. Returns false if it does not.
+static bool checkParallelParse(const string& fileName, int threadCount, size_t chunkSize) {
+    Tokenizer file;
+    if (!file.openFile(fileName)) {
+        fprintf(stderr, "Unable to open file %s\n", fileName.c_str());
+        exit(1);
+    }
+    vector<LinkInput> inputs = {LinkInput{fileName, file.inputBegin(), (size_t) (file.inputEnd() - file.inputBegin())}};
+    LinkContext serial(machine);
+    string expected = serial.link(inputs).listing;
+
+    LinkContext parallel(machine);
+    parallel.threadCount = threadCount;
+    parallel.parallelChunkSize = chunkSize;
+    parallel.concurrentSymbols = true;
+    bool same = parallel.link(inputs).listing == expected;
+    printf("%-10s parallel parse, %d threads, %zu-byte chunks: %s\n", fileName.c_str(), threadCount, chunkSize,
+           same ? "same as serial" : "DIFFERENT from serial");
+    return same;
+}
+
+
+// Function to stress the concurrent symbol table against the serial one. Definitions with many
+// repeated names are added from threadCount threads in a different interleaving every round,
+// later definitions often first; every round must resolve each name to the same definition, flag
+// the same definitions and list the symbols in the same order as the serial table. Returns the
+// number of rounds that did not.
+static int benchSymbols(int threadCount) {
+    const int definitionCount = 1 << 18;
+    const int nameCount = 1 << 15;
+    const int rounds = 20;
+
+    vector<string> names(nameCount);
+    for (int i = 0; i < nameCount; i++) names[i] = "sym" + to_string(i * 2654435761u % 1000003);
+    vector<Symbol> definitions(definitionCount);
+    uint64_t state = 88172645463325252ULL;
+    for (int i = 0; i < definitionCount; i++) {
+        state ^= state << 13, state ^= state >> 7, state ^= state << 17;
+        definitions[i].value = names[state % nameCount];
+        definitions[i].moduleNumber = i / 4 + 1;       // Several definitions per module, ranks break the ties
+        definitions[i].relativeAddr = state >> 40 & 3;
+        definitions[i].Addr = i + definitions[i].relativeAddr;
+    }
+
+    SymbolTable serial;
+    vector<char> serialFlags(definitionCount);
+    PhaseTimer serialTimer;
+    for (int i = 0; i < definitionCount; i++) serialFlags[i] = !serial.insert(definitions[i]);
+    double serialMs = serialTimer.wallSeconds() * 1e3;
+
+    int failedRounds = 0;
+    double bestMs = -1;
+    double bestOrderMs = -1;    // Of the flags and the ordered table, after the inserts
+    for (int round = 0; round < rounds; round++) {
+        ConcurrentSymbolTable shared;
+        vector<int64_t> places(definitionCount);
+        PhaseTimer timer;
+        {
+            ThreadPool pool(threadCount);
+            for (int t = 0; t < threadCount; t++) {
+                pool.submit([&, t] {
+                    // Strided, and backwards every other round, so arrival order differs from rank order
+                    for (int k = t; k < definitionCount; k += threadCount) {
+                        int i = round % 2 ? definitionCount - 1 - k : k;
+                        places[i] = shared.insert(definitions[i], i);
+                    }
+                });
+            }
+            pool.wait();
+        }
+        PhaseTimer orderTimer;
+        vector<char> flags(definitionCount);
+        for (int i = 0; i < definitionCount; i++) flags[i] = shared.rankAt(places[i]) != i;
+        SymbolTable table = shared.ordered(definitionCount);
+        double orderMs = orderTimer.wallSeconds() * 1e3;
+        double ms = timer.wallSeconds() * 1e3;
+        if (bestMs < 0 || ms < bestMs) bestMs = ms;
+        if (bestOrderMs < 0 || orderMs < bestOrderMs) bestOrderMs = orderMs;
+
+        bool same = table.size() == serial.size();
+        for (size_t i = 0; same && i < table.size(); i++) {
+            same = table[i].value == serial[i].value && table[i].Addr == serial[i].Addr && table[i].relativeAddr == serial[i].relativeAddr
+                && table[i].moduleNumber == serial[i].moduleNumber && table[i].alreadyDefined == serial[i].alreadyDefined
+                && table[i].used == serial[i].used;
+        }
+        same = same && flags == serialFlags;
+        if (!same) failedRounds++;
+    }
+
+    printf("symbol table stress     %d definitions, %d names, %d threads, %d rounds: %d mismatched | serial %.3f ms | concurrent %.3f ms (%.3f ms flagging and ordering)\n",
+           definitionCount, nameCount, threadCount, rounds, failedRounds, serialMs, bestMs, bestOrderMs);
+    return failedRounds;
+}
+
+
+int main(int argc, char** argv) {
+    vector<string> fileNames;
+    int threadCount = 1;
+    int repeat = 0;             // Links per file, 0 to pick by size
+    bool micro = false;
+    bool symbols = false;
+    size_t parseChunkSize = 0;  // Check the parallel first pass with chunks this small instead of benchmarking
+
+    bool validArguments = true;
+    for (int i = 1; i < argc; i++) {
+        string argument = argv[i];
+        if (argument == "--micro") micro = true;
+        else if (argument == "--symbols") symbols = true;
+        else if (argument == "--concurrent-symbols") concurrentSymbols = true;
+        else if (argument == "--parse-chunks" && i + 1 < argc) parseChunkSize = max(1, atoi(argv[++i]));
+        else if (argument == "-j" && i + 1 < argc) threadCount = max(1, atoi(argv[++i]));
+        else if (argument == "--repeat" && i + 1 < argc) repeat = max(1, atoi(argv[++i]));
+        else if (argument == "--machine" && i + 1 < argc) validArguments = validArguments && machine.parse(argv[++i]);
+        else fileNames.push_back(argument);
+    }
+    if (!validArguments || (fileNames.empty() && !micro && !symbols)) {
+        fprintf(stderr, "Usage: %s [-j threads] [--repeat n] [--machine <model>] [--concurrent-symbols] <input-file>...\n"
+                        "       %s --micro\n"
+                        "       %s [-j threads] --symbols\n"
+                        "       %s [-j threads] [--machine <model>] --parse-chunks <bytes> <input-file>...\n", argv[0], argv[0], argv[0], argv[0]);
+        return 1;
+    }
+
+    if (parseChunkSize > 0) {
+        bool same = true;
+        for (const string& fileName : fileNames) same = checkParallelParse(fileName, max(2, threadCount), parseChunkSize) && same;
+        return same ? 0 : 1;
+    }
+    for (const string& fileName : fileNames) benchFile(fileName, threadCount, repeat);
+    if (micro) benchMicro();
+    if (symbols && benchSymbols(max(2, threadCount)) != 0) return 1;
+    return 0;
+}
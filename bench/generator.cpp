@@ -0,0 +1,231 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include "../MachineModel.h"
+#include "../OutputBuffer.h"
+
+using namespace std;
+
+MachineModel machineModel;  // Model the generated objects are valid for
+
+
+// Class holding the generator's knobs
+class GeneratorOptions {
+public:
+    uint64_t size = 0;              // Stop once this many bytes are written, 0 to use moduleCount
+    uint64_t moduleCount = 10;
+    int maxDefinitions = 4;         // Per module, capped by the machine model
+    int maxUses = 4;
+    int maxInstructions = 32;
+    int mix[5] = {1, 1, 1, 1, 1};   // Weights of M, A, R, I and E instructions
+    int symbolLength = 8;           // Longest generated symbol name, capped by the machine model
+    double errorDensity = 0;        // Chance of a deliberate (non-fatal) error per module
+    bool parseError = false;        // End the object with a parse error
+    uint64_t seed = 1;
+};
+
+
+// Class generating one deterministic object file. Random numbers come straight from mt19937_64,
+// whose sequence is fixed by the standard, so a seed gives the same file everywhere.
+class Generator {
+private:
+    const GeneratorOptions& options;
+    OutputBuffer& out;
+    mt19937_64 random;
+    uint64_t written = 0;           // Bytes written so far
+    uint64_t modules = 0;           // Modules written so far
+    int64_t instructions = 0;       // Instructions written so far
+    uint64_t symbols = 0;           // Symbols defined so far, named by their number
+    bool parseErrorWritten = false;
+
+    // Function to return a random number in [0, bound)
+    uint64_t below(uint64_t bound) { return bound == 0 ? 0 : random() % bound; }
+
+    // Function to write text, counting the bytes
+    void put(const string& text) {
+        out.append(text);
+        written += text.size();
+    }
+
+    // Function to write a separator: mostly a space, sometimes a tab or a line break
+    void separator() {
+        uint64_t choice = below(16);
+        put(choice == 0 ? "\n" : choice == 1 ? "\t" : " ");
+    }
+
+    // Function to name symbol number n. Names start with a letter and are padded to a length
+    // picked from the number, so the name of a symbol is the same wherever it is written.
+    string symbolName(uint64_t n) {
+        static const char letters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+        static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+        string name(1, letters[n % 52]);
+        for (uint64_t rest = n / 52; rest > 0; rest /= 36) name += digits[rest % 36];
+        int length = min(symbolLimit(), max<int>(name.size(), 1 + n * 7 % symbolLimit()));
+        while (name.size() < length) name += 'x';
+        return name;
+    }
+
+    int symbolLimit() const { return max(1, min(options.symbolLength, machineModel.maxSymbolLength)); }
+
+    // Function to pick an addressing mode by the configured weights
+    char pickMode() {
+        int total = 0;
+        for (int weight : options.mix) total += weight;
+        int pick = below(max(total, 1));
+        for (int m = 0; m < 5; m++) {
+            if (pick < options.mix[m]) return "MARIE"[m];
+            pick -= options.mix[m];
+        }
+        return 'R';
+    }
+
+public:
+    Generator(const GeneratorOptions& options, OutputBuffer& out) : options(options), out(out), random(options.seed) {}
+
+    // Function to tell whether another module should be written
+    bool wantsModule() const {
+        if (options.size > 0) return written < options.size;
+        return modules < options.moduleCount;
+    }
+
+    // Function to write one module. Returns false if the machine has no room left for it.
+    bool module() {
+        int instructionCount = 1 + below(max(1, options.maxInstructions));
+        if (instructions + instructionCount > machineModel.memorySize) return false;
+        bool faulty = options.errorDensity > 0 && below(1000000) < options.errorDensity * 1000000;
+        // The parse error goes into the last module, or the first one within 4 KB of the size
+        bool last = options.size > 0 ? written + 4096 >= options.size : modules + 1 == options.moduleCount;
+        bool parseError = last && options.parseError && !parseErrorWritten;
+        parseErrorWritten = parseErrorWritten || parseError;
+        uint64_t fault = below(9);
+
+        // Definitions, with fresh names; a faulty module may redefine an older symbol instead
+        int definitionCount = below(min(options.maxDefinitions, machineModel.maxDefinitions) + 1);
+        if (parseError && fault % 3 == 0) definitionCount = machineModel.maxDefinitions + 1;
+        put(to_string(definitionCount));
+        for (int i = 0; i < definitionCount; i++) {
+            separator();
+            bool redefine = faulty && fault == 0 && i == 0 && symbols > 0;
+            put(symbolName(redefine ? below(symbols) : symbols++));
+            separator();
+            // An address past the module is reported and treated as zero
+            put(to_string(faulty && fault == 1 && i == 0 ? instructionCount + below(10) : below(instructionCount)));
+        }
+        separator();
+
+        // Uses, referring to symbols defined so far (or to an undefined one in a faulty module)
+        int useCount = min<uint64_t>(below(min(options.maxUses, machineModel.maxUses) + 1), symbols);
+        if (faulty && fault == 2 && useCount < machineModel.maxUses) useCount++;
+        put(to_string(useCount));
+        for (int i = 0; i < useCount; i++) {
+            separator();
+            bool undefined = faulty && fault == 2 && i == useCount - 1;
+            // Generated names never have an upper case letter after the first character
+            string undefinedName = ("zZ" + to_string(modules)).substr(0, machineModel.maxSymbolLength);
+            put(undefined ? undefinedName : symbolName(below(symbols)));
+        }
+        separator();
+
+        // Instructions, with operands valid for their addressing mode
+        put(to_string(instructionCount));
+        int64_t radix = machineModel.opcodeRadix;
+        for (int i = 0; i < instructionCount; i++) {
+            char mode = pickMode();
+            if (mode == 'E' && useCount == 0) mode = 'R';
+            int64_t operand = 0;
+            switch (mode) {
+                case 'M': operand = below(min<uint64_t>(modules + 1, radix)); break;
+                case 'A': operand = below(min(machineModel.memorySize, radix)); break;
+                case 'R': operand = below(min<int64_t>(instructionCount, radix)); break;
+                case 'I': operand = below(machineModel.immediateLimit); break;
+                case 'E': operand = below(useCount); break;
+            }
+            int64_t address = below(machineModel.opcodeCount) * radix + operand;
+            // A faulty module breaks its first instruction in one of the ways the linker reports
+            if (faulty && i == 0 && fault >= 3) {
+                static const char faultModes[] = "MARIEI";
+                mode = faultModes[fault - 3];
+                if (fault == 8) address = machineModel.largestInstruction() + 1;
+                else if (mode == 'M') address = address / radix * radix + radix - 1;
+                else if (mode == 'A') address = address / radix * radix + min(machineModel.memorySize, radix - 1);
+                else if (mode == 'R') address = address / radix * radix + min<int64_t>(instructionCount, radix - 1);
+                else if (mode == 'I') address = address / radix * radix + machineModel.immediateLimit;
+                else if (mode == 'E') address = address / radix * radix + min<int64_t>(useCount, radix - 1);
+            }
+            if (parseError && fault % 3 == 1 && i == instructionCount - 1) mode = 'X';
+            separator();
+            put(string(1, mode));
+            separator();
+            put(to_string(address));
+        }
+        if (parseError && fault % 3 == 2) put(" 1 9bad");
+        put("\n");
+
+        instructions += instructionCount;
+        modules++;
+        return true;
+    }
+
+    uint64_t bytesWritten() const { return written; }
+};
+
+
+// Function to read a byte count with an optional K, M or G suffix
+static bool readSize(const char* text, uint64_t& size) {
+    char* end;
+    size = strtoull(text, &end, 10);
+    if (*end == 'K' || *end == 'k') size <<= 10, end++;
+    else if (*end == 'M' || *end == 'm') size <<= 20, end++;
+    else if (*end == 'G' || *end == 'g') size <<= 30, end++;
+    return end != text && *end == 0;
+}
+
+
+int main(int argc, char** argv) {
+    GeneratorOptions options;
+    bool validArguments = true;
+    for (int i = 1; i < argc && validArguments; i++) {
+        string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (argument == "--size" && hasValue) validArguments = readSize(argv[++i], options.size);
+        else if (argument == "--modules" && hasValue) options.moduleCount = strtoull(argv[++i], nullptr, 10);
+        else if (argument == "--defs" && hasValue) options.maxDefinitions = atoi(argv[++i]);
+        else if (argument == "--uses" && hasValue) options.maxUses = atoi(argv[++i]);
+        else if (argument == "--instructions" && hasValue) options.maxInstructions = atoi(argv[++i]);
+        else if (argument == "--mix" && hasValue) {
+            validArguments = sscanf(argv[++i], "%d,%d,%d,%d,%d", &options.mix[0], &options.mix[1], &options.mix[2],
+                                    &options.mix[3], &options.mix[4]) == 5;
+        }
+        else if (argument == "--symbol-length" && hasValue) options.symbolLength = atoi(argv[++i]);
+        else if (argument == "--errors" && hasValue) options.errorDensity = atof(argv[++i]);
+        else if (argument == "--parse-error") options.parseError = true;
+        else if (argument == "--seed" && hasValue) options.seed = strtoull(argv[++i], nullptr, 10);
+        else if (argument == "--machine" && hasValue) validArguments = machineModel.parse(argv[++i]);
+        else validArguments = false;
+    }
+    for (int weight : options.mix) validArguments = validArguments && weight >= 0;
+
+    if (!validArguments) {
+        fprintf(stderr, "Usage: %s [--size bytes[K|M|G] | --modules n] [--defs n] [--uses n] [--instructions n]\n"
+                        "       [--mix m,a,r,i,e] [--symbol-length n] [--errors fraction] [--parse-error]\n"
+                        "       [--seed n] [--machine <model>]\n", argv[0]);
+        return 1;
+    }
+
+    OutputBuffer out(STDOUT_FILENO);
+    Generator generator(options, out);
+    bool room = true;
+    while (room && generator.wantsModule()) {
+        room = generator.module();
+    }
+    if (!room) {
+        fprintf(stderr, "%s: the machine model is full, pass a larger --machine words=\n", argv[0]);
+        out.flush();
+        return 1;
+    }
+    out.flush();
+    return 0;
+}
@@ -1,47 +1,210 @@
-#include <iostream>
 #include "Token.h"
-#include "Parser.h"
+#include "OutputBuffer.h"
+#include "ObjectFormat.h"
+#include "Library.h"
+#include "LinkContext.h"
+#include "LinkServer.h"
+#include "LinkBatch.h"
+#include "MemoryImage.h"
+#include <cerrno>
+#include <climits>
 
 using namespace std;
 
-extern vector<Module> module_base;
-
 int main(int argc, char** argv) {
-    // Check if the number of command-line arguments is not = 2 (program name + one input file).
-    if (argc != 2) {
-        cout << "Usage: " << argv[0] << " <input-file>\n";
+    vector<string> fileNames;   // Input files, linked as consecutive modules in this order
+    int threadCount = 1;    // Number of threads relocating modules in the second pass (-j N)
+    MachineModel machine;   // Machine the modules are linked for (--machine <model>)
+
+    string convertOutput;   // Binary object to write instead of linking (--convert <output>)
+    string archiveOutput;   // Library to build from the inputs instead of linking (--archive <output>)
+    string cacheFile;       // Incremental link cache reused and updated by the link (--cache <file>)
+    bool keepGoing = false;     // Report every parse error instead of stopping at the first (--keep-going)
+    bool streaming = false;     // Relocate in a reader, relocator and writer pipeline with bounded memory (--stream)
+    bool printStats = false;    // Report phase times and counters as JSON on stderr (--stats)
+    string traceFile;           // Chrome trace-event file of the link (--trace <file>)
+    string serveSocket;     // Socket to serve link jobs on instead of linking (--serve <socket>)
+    string connectSocket;   // Link server to send the link to (--connect <socket>)
+    bool sendContents = false;  // Send the inputs' contents to the server instead of their paths (--inline)
+    string batchList;       // List of independent jobs to link instead of the input files (--batch <list>)
+    string imageFile;       // Memory image to write instead of listing the memory map (--image <file>)
+    bool writeRelocations = false;  // Write the image's relocation records alongside it (--relocations)
+    vector<int> rootModules;    // Modules kept with everything they reference, the rest dropped (--gc-modules <roots>)
+    string rebaseAddress;   // Base to move an existing image to instead of linking (--rebase <base-address>)
+
+    // Parse the options, everything else is the input file
+    bool validArguments = true;
+    for (int i = 1; i < argc; i++) {
+        string argument = argv[i];
+        if (argument == "--convert" && i + 1 < argc) {
+            convertOutput = argv[++i];
+        } else if (argument == "--archive" && i + 1 < argc) {
+            archiveOutput = argv[++i];
+        } else if (argument == "--cache" && i + 1 < argc) {
+            cacheFile = argv[++i];
+        } else if (argument == "--machine" && i + 1 < argc) {
+            // Machine model descriptor, e.g. words=65536,radix=100000,immediate=90000
+            if (!machine.parse(argv[++i])) validArguments = false;
+        } else if (argument == "--keep-going") {
+            keepGoing = true;
+        } else if (argument == "--stream") {
+            streaming = true;
+        } else if (argument == "--stats") {
+            printStats = true;
+        } else if (argument == "--trace" && i + 1 < argc) {
+            traceFile = argv[++i];
+        } else if (argument == "--serve" && i + 1 < argc) {
+            serveSocket = argv[++i];
+        } else if (argument == "--connect" && i + 1 < argc) {
+            connectSocket = argv[++i];
+        } else if (argument == "--inline") {
+            sendContents = true;
+        } else if (argument == "--batch" && i + 1 < argc) {
+            batchList = argv[++i];
+        } else if (argument == "--image" && i + 1 < argc) {
+            imageFile = argv[++i];
+        } else if (argument == "--gc-modules" && i + 1 < argc) {
+            // Comma separated module numbers, as listed in warnings, e.g. 0,4
+            const char* list = argv[++i];
+            do {
+                char* end;
+                long root = strtol(list, &end, 10);
+                if (end == list || root < 0 || root > INT_MAX || (*end != ',' && *end != '\0')) {
+                    validArguments = false;
+                    break;
+                }
+                rootModules.push_back(root);
+                list = *end == ',' ? end + 1 : end;
+            } while (*list != '\0');
+        } else if (argument == "--relocations") {
+            writeRelocations = true;
+        } else if (argument == "--rebase" && i + 1 < argc) {
+            rebaseAddress = argv[++i];
+        } else if (argument == "-j" && i + 1 < argc) {
+            threadCount = atoi(argv[++i]);
+            if (threadCount < 1) validArguments = false;
+        } else {
+            fileNames.push_back(argument);
+        }
+    }
+
+    // At least one input file is required, except by the server and a batch, and conversion and rebasing take exactly one
+    int modes = !convertOutput.empty() + !archiveOutput.empty() + !serveSocket.empty() + !connectSocket.empty() + !batchList.empty()
+              + !rebaseAddress.empty();
+    bool inputsExpected = serveSocket.empty() && batchList.empty();
+    if (!batchList.empty() && (!cacheFile.empty() || printStats || !traceFile.empty())) validArguments = false;
+    if (!imageFile.empty() && modes > 0) validArguments = false;
+    if (writeRelocations && imageFile.empty()) validArguments = false;
+    if ((!convertOutput.empty() || !rebaseAddress.empty()) && fileNames.size() != 1) validArguments = false;
+    if (modes > 1 || (sendContents && connectSocket.empty())) validArguments = false;
+    if (!validArguments || fileNames.empty() == inputsExpected) {
+        OutputBuffer out(STDOUT_FILENO);
+        out.append("Usage: " + string(argv[0]) + " [-j threads] [--machine <model>] [--cache <file>] [--keep-going] [--stream] [--gc-modules <roots>] [--image <file> [--relocations]] [--stats] [--trace <file>] <input-file>...\n");
+        out.append("       " + string(argv[0]) + " --convert <binary-object> <input-file>\n");
+        out.append("       " + string(argv[0]) + " --archive <library> <input-file>...\n");
+        out.append("       " + string(argv[0]) + " [-j threads] [--machine <model>] --serve <socket>\n");
+        out.append("       " + string(argv[0]) + " --connect <socket> [--inline] <input-file>...\n");
+        out.append("       " + string(argv[0]) + " [-j threads] [--machine <model>] [--keep-going] [--stream] [--gc-modules <roots>] --batch <list>\n");
+        out.append("       " + string(argv[0]) + " --rebase <base-address> <image>\n");
         return 1;
     }
 
-    // Filename is at index 1 (since index 0 is the program name).
-    string fileName = argv[1];
+    // Serve link jobs until stopped instead of linking
+    if (!serveSocket.empty()) {
+        OutputBuffer out(STDOUT_FILENO);
+        return serveLinks(serveSocket, machine, threadCount, out);
+    }
 
-    // Perform the first pass of the linker, generating an initial symbol table.
-    vector<Symbol> symbolTable = firstPass(fileName); 
+    // Have a link server link the inputs
+    if (!connectSocket.empty()) {
+        OutputBuffer out(STDOUT_FILENO);
+        return requestLink(connectSocket, fileNames, sendContents, out);
+    }
 
-    cout << "Symbol Table" << endl;
-    // Iterate through the symbol table to print each symbol and its address.
-    for (auto& symbol : symbolTable) {
-        cout << symbol.value << "=" << symbol.Addr;
-        // If the symbol is defined multiple times, the first definition is used.
-        if (symbol.alreadyDefined) {
-            cout << " Error: This variable is multiple times defined; first value used";
-        } cout << endl;
+    // Link every job of the batch list instead of the input files
+    if (!batchList.empty()) {
+        OutputBuffer out(STDOUT_FILENO);
+        BatchOptions options;
+        options.machine = machine;
+        options.threadCount = threadCount;
+        options.keepGoing = keepGoing;
+        options.streaming = streaming;
+        options.rootModules = rootModules;
+        return linkBatch(batchList, options, out);
     }
 
-    cout << "\nMemory Map" << endl;
-    // Perform the second pass of the linker, updating the symbol table with final addresses.
-    symbolTable = secondPass(fileName, symbolTable);
-    cout << endl; // Print an empty line for formatting.
+    // Move an image written with --relocations to a new base instead of linking
+    if (!rebaseAddress.empty()) {
+        OutputBuffer out(STDOUT_FILENO);
+        char* end;
+        errno = 0;
+        int64_t baseAddress = strtoll(rebaseAddress.c_str(), &end, 10);
+        string problem;
+        if (*end != '\0' || errno != 0) {
+            problem = "invalid base address " + rebaseAddress;
+        } else if (rebaseImage(fileNames[0], baseAddress, problem)) {
+            return 0;
+        }
+        out.append("Unable to rebase image: " + problem + "\n");
+        return 1;
+    }
 
-    // Iterate through the final symbol table to check for unused symbols.
-    for (auto symbol : symbolTable) {
-        // If a symbol was defined but never used, print a warning message.
-        if (!symbol.used) {
-            cout << "Warning: Module " << symbol.moduleNumber - 1 << ": " << symbol.value << " was defined but never used" << endl;
+    // Convert the input to a binary object instead of linking it
+    if (!convertOutput.empty()) {
+        OutputBuffer out(STDOUT_FILENO);
+        return convertObject(fileNames[0], convertOutput, machine, out);
+    }
+
+    // Build a library from the inputs instead of linking them
+    if (!archiveOutput.empty()) {
+        OutputBuffer out(STDOUT_FILENO);
+        return buildLibrary(fileNames, archiveOutput, machine, out);
+    }
+
+    OutputBuffer out(STDOUT_FILENO);    // All output goes through this buffer
+
+    // Map every input before linking, a missing file ends the run without a listing
+    vector<Tokenizer> files(fileNames.size());
+    vector<LinkInput> inputs;
+    for (int f = 0; f < fileNames.size(); f++) {
+        if (!files[f].openFile(fileNames[f])) {
+            out.append("Unable to open file " + fileNames[f] + "\n");
+            return 0;
         }
+        inputs.push_back(LinkInput{fileNames[f], files[f].inputBegin(), (size_t) (files[f].inputEnd() - files[f].inputBegin())});
+    }
+
+    LinkContext context(machine);
+    context.threadCount = threadCount;
+    context.keepGoing = keepGoing;
+    context.streaming = streaming;
+    context.rootModules = rootModules;
+    context.stats.enabled = printStats || !traceFile.empty();
+    context.stats.tracing = !traceFile.empty();
+    LinkCache cache(machine);   // Modules remembered from the previous link
+    if (!cacheFile.empty()) {
+        cache.load(cacheFile);  // A missing or stale cache file just means a clean link
+        context.cache = &cache;
     }
 
-    return 0;
+    MemoryImage image;          // Memory map of the link, when it goes to an image
+    if (!imageFile.empty()) context.image = &image;
+    image.recordFixups = writeRelocations;
+
+    LinkResult result = context.link(inputs, out);
+    if (context.cache && result.status == 0) cache.save(cacheFile, result.modules);
+
+    // Only a complete link is written as an image
+    string problem;
+    if (context.image && result.status == 0 && !writeImage(image, machine, imageFile, problem)) {
+        out.append("Unable to write image: " + problem + "\n");
+        out.flush();
+        result.status = 1;
+    }
+
+    if (printStats) fputs(context.stats.json(result.modules, context.cache, machine).c_str(), stderr);
+    if (!traceFile.empty() && !context.stats.writeTrace(traceFile)) fprintf(stderr, "Unable to write trace %s\n", traceFile.c_str());
+
+    return result.status;
     // end of program
 }